@@ -0,0 +1,13 @@
+// bench.c - entry point of `make bench`, see src/benchmarks.c and src/checks.c
+
+#include "benchmarks.h"
+#include "checks.h"
+
+int main(int argc, char** argv) {
+    // optional kernel name filter, e.g. `make bench FILTER=upscale`
+    const char* filter = argc > 1 && argv[1][0] ? argv[1] : NULL;
+
+    // timings of wrong kernels are meaningless, so the checks go first
+    if (lumino_run_checks(filter) != LUMINO_SUCCESS) return 1;
+    return lumino_run_benchmarks(filter);
+}
@@ -0,0 +1,41 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bump allocator for scratch memory. Allocations are 64-byte aligned (a cache
+// line, a full AVX-512 register) and are never freed one by one: reset drops
+// everything at once. When a block runs out a new one is chained on, and the
+// next reset folds the chain into a single block large enough for all of it,
+// so a workload that repeats every frame stops touching the heap after its
+// first frame.
+
+#define LUMINO_ARENA_ALIGN 64
+
+typedef struct lumino_arena_block lumino_arena_block;
+
+typedef struct {
+    lumino_arena_block* head;            // block allocations come from, NULL before the first one
+    size_t block_size;                   // minimum size of a new block
+    size_t used;                         // bytes handed out since the last reset (all blocks)
+    size_t peak;                         // largest used seen at a reset
+    uint64_t heap_allocations;           // blocks ever malloc'd, constant once the arena is warm
+} lumino_arena;
+
+// Set up an empty arena; nothing is allocated until the first lumino_arena_alloc
+void lumino_arena_init(lumino_arena* arena, size_t block_size);
+
+// size bytes, 64-byte aligned, uninitialized. NULL when the heap is exhausted.
+void* lumino_arena_alloc(lumino_arena* arena, size_t size);
+
+// Same, zero-filled
+void* lumino_arena_calloc(lumino_arena* arena, size_t count, size_t size);
+
+// Release every allocation. Keeps one block sized for the peak usage.
+void lumino_arena_reset(lumino_arena* arena);
+
+// Free all blocks
+void lumino_arena_destroy(lumino_arena* arena);
+
+#endif // __ARENA_H__
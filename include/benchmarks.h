@@ -4,6 +4,9 @@
 #include "lumino.h"
 #include "primitives.h"
 
-void benchmark_lines(LuminoRenderer* r);
+// Run the headless kernel microbenchmarks at a few internal resolutions and
+// print ns/pixel, GB/s and the speedup over scalar for every SIMD level this
+// CPU supports. filter (may be NULL) keeps only kernels whose name contains it.
+int lumino_run_benchmarks(const char* filter);
 
-#endif // __BENCHMARKS_H__
\ No newline at end of file
+#endif // __BENCHMARKS_H__
@@ -0,0 +1,15 @@
+#ifndef __CHECKS_H__
+#define __CHECKS_H__
+
+#include "lumino.h"
+#include "primitives.h"
+
+// Headless correctness checks for the SIMD kernels and the alternate render
+// paths, run by `make bench` before the timings. Each check draws random
+// scenes at every SIMD level this CPU supports and compares the result with
+// a reference (scalar blend math, immediate mode, ...). filter (may be NULL)
+// keeps only checks whose name contains it. Returns LUMINO_FAILURE if any
+// pixel differs.
+int lumino_run_checks(const char* filter);
+
+#endif // __CHECKS_H__
@@ -0,0 +1,75 @@
+#ifndef __DEFERRED_H__
+#define __DEFERRED_H__
+
+#include "lumino.h"
+#include "sprite.h"
+
+// Deferred tile rasterizer (LUMINO_FLAG_DEFERRED). The primitives and sprite
+// blits append a command to a buffer in the frame arena instead of drawing.
+// lumino_flush bins the commands into LUMINO_TILE_SIZE square screen tiles and
+// rasterizes the tiles in parallel on the renderer's worker pool, each tile
+// running its commands in submission order, so the result is the same as
+// drawing immediately. lumino_clear, lumino_present and the profile overlay
+// flush on their own; flush before reading or writing the buffers directly.
+
+#define LUMINO_TILE_SIZE 32
+
+// Command ops
+#define LUMINO_CMD_PIXEL 0
+#define LUMINO_CMD_PIXEL_BLEND 1
+#define LUMINO_CMD_LINE 2
+#define LUMINO_CMD_LINE_BLEND 3
+#define LUMINO_CMD_FILL 4
+#define LUMINO_CMD_FILL_BLEND 5
+#define LUMINO_CMD_SPRITE 6
+#define LUMINO_CMD_SPRITE_BLEND 7
+#define LUMINO_CMD_SPRITE_LIT 8
+#define LUMINO_CMD_PIXEL_INDEX 9
+#define LUMINO_CMD_LINE_INDEX 10
+#define LUMINO_CMD_FILL_INDEX 11
+#define LUMINO_CMD_SPRITE_INDEX 12
+#define LUMINO_CMD_SPRITE_LIGHTMAP 13
+
+// One recorded draw call
+typedef struct {
+    int op;                              // LUMINO_CMD_*
+    union {
+        struct {
+            int x, y, w, h;              // pixels are 1x1 rects
+            lumino_color color;
+            uint8_t index;               // *_INDEX ops
+        } rect;
+        struct {
+            int x1, y1, x2, y2;
+            lumino_color color;
+            uint8_t index;
+        } line;
+        struct {
+            lumino_sprite sprite;
+            lumino_light light;          // SPRITE_LIT only
+            float ambient;
+        } sprite;
+    };
+} lumino_command;
+
+typedef struct lumino_deferred lumino_deferred;
+
+// Run every recorded command and empty the buffer. Does nothing outside
+// deferred mode or when nothing was recorded.
+void lumino_flush(LuminoRenderer* renderer);
+
+// Used by primitives.c and sprite.c: a command slot to fill in, or NULL when
+// the renderer draws immediately (not deferred, or out of memory after
+// flushing what was recorded, so drawing immediately keeps the order)
+lumino_command* lumino_defer(LuminoRenderer* renderer, int op);
+
+// Used by deferred.c: draw the steps of a recorded line that land in a tile
+// view whose origin is (tx, ty) on screen, stepping from the recorded
+// endpoints so every kernel (NEON float stepping too) places them exactly
+// as the immediate draw does
+void lumino_replay_line(LuminoRenderer* view, const lumino_command* c, int tx, int ty);
+
+// Used by lumino.c: set up deferred mode, memory from the persistent arena
+int lumino_deferred_init(LuminoRenderer* renderer);
+
+#endif // __DEFERRED_H__
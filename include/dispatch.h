@@ -0,0 +1,74 @@
+#ifndef __DISPATCH_H__
+#define __DISPATCH_H__
+
+// Runtime SIMD kernel selection. Every module keeps a small table of kernel
+// pointers (scalar by default); lumino_dispatch_init fills them for the best
+// level the CPU supports, or the one forced with the LUMINO_SIMD environment
+// variable (scalar, sse2, avx2, neon).
+//
+// x86 kernels are compiled with per-function target attributes, so the build
+// itself only assumes the baseline ISA and AVX2 code runs only where cpuid
+// reports it. NEON is baseline wherever it is compiled in.
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LUMINO_X86 1
+#define LUMINO_TARGET_SSE2 __attribute__((target("sse2")))
+#define LUMINO_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+
+// x / 255 (rounded down) for x <= 65280 + 255, in 16-bit lanes. Shared by
+// the src-over kernels, which add 127 first to round like lumino_blend_packed.
+// The NEON version is below.
+LUMINO_TARGET_SSE2
+static inline __m128i lumino_div255_epu16_sse2(__m128i x)
+{
+    __m128i t = _mm_add_epi16(x, _mm_srli_epi16(x, 8));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_set1_epi16(1)), 8);
+}
+
+LUMINO_TARGET_AVX2
+static inline __m256i lumino_div255_epu16_avx2(__m256i x)
+{
+    __m256i t = _mm256_add_epi16(x, _mm256_srli_epi16(x, 8));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_set1_epi16(1)), 8);
+}
+#endif
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+// Same rounding as the x86 helpers above
+static inline uint16x8_t lumino_div255_epu16_neon(uint16x8_t x)
+{
+    uint16x8_t t = vaddq_u16(x, vshrq_n_u16(x, 8));
+    return vshrq_n_u16(vaddq_u16(t, vdupq_n_u16(1)), 8);
+}
+#endif
+
+#define LUMINO_SIMD_SCALAR 0
+#define LUMINO_SIMD_SSE2 1
+#define LUMINO_SIMD_AVX2 2
+#define LUMINO_SIMD_NEON 3
+
+// Best level this CPU supports
+int lumino_dispatch_detect(void);
+
+// Detect once and select kernels, honouring LUMINO_SIMD. Called by lumino_init.
+void lumino_dispatch_init(void);
+
+// Select the kernels of a specific level (e.g. to compare levels in benchmarks).
+// Returns LUMINO_FAILURE and keeps the current selection if the CPU lacks it.
+int lumino_dispatch_select(int level);
+
+// Level currently in use
+int lumino_dispatch_level(void);
+
+// "scalar", "sse2", "avx2" or "neon"
+const char* lumino_dispatch_name(int level);
+
+// Per-module table updates, called by lumino_dispatch_select
+void lumino_upscale_select_kernels(int level);
+void lumino_primitives_select_kernels(int level);
+void lumino_sprite_select_kernels(int level);
+
+#endif // __DISPATCH_H__
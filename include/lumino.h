@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <SDL.h>
 #include "upscale.h"
+#include "arena.h"
 
 //#define LUMINO_NO_NEON 
 
@@ -11,7 +12,17 @@
 #define LUMINO_FAILURE 1
 #define LUMINO_DIMS_TOO_SMALL 2
 #define LUMINO_INVALID_UPSCALE 3
-#define LUMINO_DIMS_NOT_DIVISIBLE_BY_4 4
+#define LUMINO_DIMS_NOT_DIVISIBLE_BY_4 4 // no longer returned, any width and height work
+
+// Flags for lumino_init_ex (bitwise OR)
+#define LUMINO_FLAG_ZERO_COPY 0x1        // upscale straight into the locked streaming texture (no framebuffer)
+#define LUMINO_FLAG_SDL_SCALE 0x2        // texture stays at internal size, SDL does the nearest-neighbor scaling
+#define LUMINO_FLAG_THREADED_UPSCALE 0x4 // upscale horizontal bands on a worker pool (one thread per CPU)
+#define LUMINO_FLAG_INDEXED 0x8          // draw 8-bit palette indices into index_buffer, converted at present
+#define LUMINO_FLAG_HEADLESS 0x10        // no window (set by lumino_init_headless), frames stay in framebuffer
+#define LUMINO_FLAG_DIRTY_RECTS 0x20     // only clear, upscale and upload the regions drawn to (see lumino_mark_dirty)
+#define LUMINO_FLAG_DEFERRED 0x40        // record draw calls, rasterize them in parallel screen tiles (deferred.h)
+#define LUMINO_FLAG_PIPELINED 0x80       // upscale frame N on a present thread while frame N+1 is drawn (see lumino_fence_wait)
 
 int mouse_location[2];
 int mouse_clicked;
@@ -25,26 +36,21 @@ static Uint8 previous_keyboard_state[SDL_NUM_SCANCODES]; // Previous keyboard st
 // internal_framebuffer is the framebuffer that gets upscaled
 
 
-typedef struct {
-    uint8_t palette[256 * 4];            // Color palette (RGBA)
-    uint8_t palette_size;                // current size of the palette
+struct lumino_thread_pool;
+struct lumino_profile;
+struct lumino_deferred;
+struct lumino_pipeline;
+struct LuminoRenderer;
 
-        
-    // 
-    // result of palette lookup for each index
-    uint32_t* internal_framebuffer;      
-    
-    // Final upscaled 32-bit framebuffer at window resolution:
-    // result of upscaling internal framebuffer (4 bytes per pixel and 2^upscale_factor as many pixels)
-    uint32_t* framebuffer;               
-    
-    int internal_width;                  // Internal rendering resolution width
-    int internal_height;                 // Internal rendering resolution height
-    int width;                           // Window width
-    int height;                          // Window height
-    int upscale_factor;                  // Upscale factor for internal framebuffer
-    void (*upscale_fn)(uint32_t* out, const uint32_t* in, int width, int height); // Function pointer for upscaling
-} LuminoRenderer;
+// Called by lumino_present in headless mode once the frame is in renderer->framebuffer
+// (pipelined: from the next lumino_present or lumino_fence_wait, on the calling thread)
+typedef void (*lumino_present_fn)(struct LuminoRenderer* renderer, void* user);
+
+#define LUMINO_MAX_PALETTE_CYCLES 16
+#define LUMINO_MAX_DIRTY_RECTS 32        // more rects than this get merged into their closest neighbour
+#define LUMINO_PALETTE_HASH_SIZE 512     // power of two, >= 2x the palette size
+#define LUMINO_STRIDE_ALIGN 16           // row padding in pixels, 16 x 4 bytes = one cache line
+#define LUMINO_MAX_LIGHTS 16             // lights in the lightmap (lumino_set_lights)
 
 typedef struct  {
     uint8_t r;
@@ -71,6 +77,93 @@ typedef struct lumino_light {
 
 } lumino_light;
 
+// A range of palette entries rotated over time at present (water shimmer,
+// fire flicker, ...) without touching the index buffer
+typedef struct {
+    uint8_t first;                       // first palette index of the range
+    uint8_t last;                        // last palette index of the range (inclusive)
+    float speed;                         // entries per second, negative rotates the other way
+} lumino_palette_cycle;
+
+// Coalesced list of rectangles in internal framebuffer pixels
+typedef struct {
+    SDL_Rect rects[LUMINO_MAX_DIRTY_RECTS];
+    int count;
+} lumino_rect_list;
+
+typedef struct LuminoRenderer {
+    uint8_t palette[256 * 4];            // Color palette (RGBA)
+    int palette_size;                    // current size of the palette (up to 256)
+    uint32_t palette_argb[256];          // same palette packed like the framebuffer (lumino_get_color)
+    uint32_t palette_cycled[256];        // palette_argb with the cycles applied, rebuilt at present
+    lumino_palette_cycle palette_cycles[LUMINO_MAX_PALETTE_CYCLES];
+    int palette_cycle_count;
+
+    // Reverse lookup, maintained by lumino_add_palette_color:
+    // open-addressing hash of packed RGBA -> index (-1 = empty slot) and a lazily
+    // allocated RGB555 -> nearest index cache (-1 = not computed yet)
+    uint32_t palette_hash_keys[LUMINO_PALETTE_HASH_SIZE];
+    int16_t palette_hash_index[LUMINO_PALETTE_HASH_SIZE];
+    int16_t* palette_nearest_cache;
+
+    // 8-bit palette indices at internal resolution, only with LUMINO_FLAG_INDEXED
+    // (NULL otherwise). Draw into it with the *_index primitives.
+    uint8_t* index_buffer;
+
+    // result of palette lookup for each index
+    // (in indexed mode the lookup is fused into the upscale and this buffer is
+    // only refreshed for LUMINO_FLAG_SDL_SCALE presents)
+    uint32_t* internal_framebuffer;      
+    
+    // Final upscaled 32-bit framebuffer at window resolution:
+    // result of upscaling internal framebuffer (4 bytes per pixel and upscale_factor^2 as many pixels)
+    // NULL with LUMINO_FLAG_ZERO_COPY, where the texture itself is the target,
+    // and with LUMINO_FLAG_SDL_SCALE, where no CPU upscale happens at all
+    uint32_t* framebuffer;               
+    
+    int internal_width;                  // Internal rendering resolution width
+    int internal_height;                 // Internal rendering resolution height
+    int width;                           // Window width
+    int height;                          // Window height
+
+    // Row lengths in pixels, padded to a multiple of LUMINO_STRIDE_ALIGN so every
+    // row starts on a 64-byte boundary. Pixel (x, y) of internal_framebuffer
+    // and index_buffer is at [y * stride + x], of framebuffer at
+    // [y * framebuffer_stride + x]. The padding columns are never shown.
+    int stride;
+    int framebuffer_stride;
+    int upscale_factor;                  // Upscale factor for internal framebuffer
+    int flags;                           // LUMINO_FLAG_* passed to lumino_init_ex
+    struct lumino_thread_pool* upscale_pool; // band-parallel upscale (and deferred tile) workers, NULL when single-threaded
+    lumino_upscale_fn upscale_fn;        // Upscaler for upscale_factor (see upscale.h)
+    lumino_present_fn present_callback;  // headless only, NULL = present just upscales
+    void* present_user;                  // passed to present_callback
+    struct lumino_profile* profile;      // stage timings (profile.h), NULL when profiling is off
+    struct lumino_deferred* deferred;    // command buffer and tile bins (deferred.h), NULL when drawing immediately
+    struct lumino_pipeline* pipeline;    // present thread and second buffer set, NULL unless LUMINO_FLAG_PIPELINED
+    uint64_t present_fence;              // frames passed to lumino_present so far, the fence of the newest one
+
+    // LUMINO_FLAG_DIRTY_RECTS only
+    lumino_rect_list dirty;              // changed since the last present: upscaled and uploaded
+    lumino_rect_list drawn;              // drawn to since the last present
+    lumino_rect_list drawn_last_frame;   // drawn to in earlier frames and not cleared since, what lumino_clear resets
+
+    // Lightmap (sprite.h): the lights set with lumino_set_lights, accumulated
+    // into per-pixel 8.8 fixed-point factors, 4 per pixel in the framebuffer's
+    // byte order (B, G, R, A), pixel (x, y) at [(y * stride + x) * 4]. Built
+    // on the first lightmapped blit after the lights change, NULL before.
+    lumino_light lights[LUMINO_MAX_LIGHTS];
+    int light_count;
+    float light_ambient;
+    uint16_t* lightmap;
+    int lightmap_stale;                  // lights changed since the last build
+
+    // Scratch memory (arena.h): frame_arena is reset at the end of every
+    // lumino_present, persistent_arena lives until lumino_shutdown
+    lumino_arena frame_arena;
+    lumino_arena persistent_arena;
+} LuminoRenderer;
+
 
 // Function prototypes
 
@@ -93,26 +186,88 @@ int lumino_is_key_up(SDL_Scancode key);
 // Initialize the renderer with specific width, height, and internal resolution
 int lumino_init(LuminoRenderer* renderer, int upscale_factor, int internal_width, int internal_height);
 
+// Same as lumino_init with LUMINO_FLAG_* options
+int lumino_init_ex(LuminoRenderer* renderer, int upscale_factor, int internal_width, int internal_height, int flags);
+
+// Initialize without SDL video: no window, renderer or texture. lumino_present
+// upscales into renderer->framebuffer (always allocated, ZERO_COPY and
+// SDL_SCALE are ignored) and hands it to the present callback if one is set.
+int lumino_init_headless(LuminoRenderer* renderer, int upscale_factor, int internal_width, int internal_height, int flags);
+
+// Set the callback lumino_present calls with each finished headless frame
+void lumino_set_present_callback(LuminoRenderer* renderer, lumino_present_fn callback, void* user);
+
 // Clean up resources
 void lumino_shutdown(LuminoRenderer* renderer);
 
-// Clear the internal framebuffer
+// Clear the internal framebuffer (with LUMINO_FLAG_DIRTY_RECTS only what was drawn since the last clear)
 void lumino_clear(LuminoRenderer* renderer);
 
+// Record that a region of the internal framebuffer changed. The primitives and
+// sprite blits do this themselves; call it after writing pixels directly.
+// Does nothing without LUMINO_FLAG_DIRTY_RECTS.
+void lumino_mark_dirty(LuminoRenderer* renderer, int x, int y, int w, int h);
+
+// Scratch memory from the renderer's arenas, 64-byte aligned. Frame allocations
+// are valid until the end of the next lumino_present, persistent ones until
+// lumino_shutdown. NULL when out of memory.
+void* lumino_frame_alloc(LuminoRenderer* renderer, size_t size);
+void* lumino_persistent_alloc(LuminoRenderer* renderer, size_t size);
+
+// Heap blocks the renderer's arenas have allocated so far. It stops moving once
+// frames reach a steady state: compare it across frames to check for that.
+uint64_t lumino_heap_allocations(const LuminoRenderer* renderer);
+
 // Perform upscaling if necessary (i.e., copy from internal to final framebuffer)
 void lumino_upscale(LuminoRenderer* renderer);
 
+// Set how many threads split the upscale into bands (0 = one per CPU, 1 = single-threaded)
+int lumino_set_upscale_threads(LuminoRenderer* renderer, int threads);
+
 // Present the final framebuffer to the window
 void lumino_present(LuminoRenderer* renderer);
 
+// Pipelined presents (LUMINO_FLAG_PIPELINED). lumino_present hands the frame
+// to a present thread, which upscales it while the next frame is drawn, and
+// shows the previous one: frames reach the window (or the headless callback)
+// one present late. SDL calls stay on the calling thread. After each present
+// internal_framebuffer and index_buffer point at the other buffer set, which
+// already holds a copy of the frame just presented, so re-read the pointers
+// rather than caching them. lumino_present itself waits until that set is free.
+// DIRTY_RECTS, ZERO_COPY and SDL_SCALE are ignored in this mode, and the present
+// thread upscales on its own (the worker pool stays with the drawing thread).
+//
+// Every present gets a fence, numbered from 1. A signaled fence means its frame
+// has been upscaled: its buffer set can be reused and, after lumino_fence_wait,
+// framebuffer holds it. Without LUMINO_FLAG_PIPELINED fences signal at once.
+uint64_t lumino_present_fence(const LuminoRenderer* renderer);  // fence of the newest present, 0 before the first
+int lumino_fence_signaled(LuminoRenderer* renderer, uint64_t fence);
+void lumino_fence_wait(LuminoRenderer* renderer, uint64_t fence);
+
 // Check if the window should continue running (event handling)
 int lumino_should_run(void);
 
 // Add a color to the palette
 void lumino_add_palette_color(LuminoRenderer* renderer, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
 
+// Index of the exact RGBA color in the palette or -1, O(1) through the palette hash
+int lumino_palette_find(LuminoRenderer* renderer, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+
+// Closest palette entry to an RGBA color. Exact matches come from the hash; for
+// opaque colors the search result is cached per RGB555 cell (so it is the
+// nearest entry to the cell, not to the exact color).
+uint8_t lumino_palette_nearest(LuminoRenderer* renderer, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+
+// Rotate palette entries [first, last] by speed entries per second at present.
+// Returns LUMINO_FAILURE for an empty range or when all cycle slots are used.
+int lumino_add_palette_cycle(LuminoRenderer* renderer, uint8_t first, uint8_t last, float speed);
+
+// Remove all palette cycles
+void lumino_clear_palette_cycles(LuminoRenderer* renderer);
+
 void lumino_get_error(int error_code, char* error_message, size_t message_size);
 
+// Linear scan of a raw RGBA palette, prefer lumino_palette_find for a renderer's palette
 lumino_pallette_contains_color(uint8_t* palette, int palette_size, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
 
 
@@ -5,6 +5,26 @@
 
 
 
+// src-over blend of two packed pixels (same layout as lumino_get_color).
+// Channels are blended byte by byte, so no unpacking to lumino_color is needed.
+static inline uint32_t lumino_blend_packed(uint32_t dst, uint32_t src) {
+    uint32_t sa = src >> 24;
+    if (sa == 0) return dst;
+    if (sa == 255) return src;
+    uint32_t inv = 255 - sa;
+
+    uint32_t out = 0;
+    for (int shift = 0; shift < 24; shift += 8) {
+        uint32_t s = (src >> shift) & 0xFF;
+        uint32_t d = (dst >> shift) & 0xFF;
+        out |= ((s * sa + d * inv + 127) / 255) << shift;
+    }
+    // composite alpha: Aout = Sa + Da*(1-Sa)
+    uint32_t da = dst >> 24;
+    out |= (sa + (da * inv + 127) / 255) << 24;
+    return out;
+}
+
 // Function prototypes for drawing primitives
 
 // draw a single pixel at (x, y) with a color (does not blend)
@@ -34,5 +54,20 @@ void lumino_fill_rectangle(LuminoRenderer* renderer, int x, int y, int width, in
 // fill a rectangle at (x, y) with width and height with a color (blends)
 void lumino_fill_rectangle_blend(LuminoRenderer* renderer, int x, int y, int width, int height, lumino_color color);
 
+// INDEXED DRAWING (LUMINO_FLAG_INDEXED)
+// These write palette indices into renderer->index_buffer, 1 byte per pixel.
+// There is no blending in indexed mode.
+
+// draw a single palette index at (x, y)
+void lumino_draw_pixel_index(LuminoRenderer* renderer, int x, int y, uint8_t index);
+
+// draw a line from (x1, y1) to (x2, y2) with a palette index
+void lumino_draw_line_index(LuminoRenderer* renderer, int x1, int y1, int x2, int y2, uint8_t index);
+
+// draw a rectangle outline at (x, y) with width and height with a palette index
+void lumino_draw_rectangle_index(LuminoRenderer* renderer, int x, int y, int width, int height, uint8_t index);
+
+// fill a rectangle at (x, y) with width and height with a palette index
+void lumino_fill_rectangle_index(LuminoRenderer* renderer, int x, int y, int width, int height, uint8_t index);
 
 #endif // __PRIMITIVES_H__
\ No newline at end of file
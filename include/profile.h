@@ -0,0 +1,49 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "lumino.h"
+
+// Per-frame stage timings. Enable with lumino_profile_enable; lumino_clear and
+// lumino_present then record how long each stage took, and the last
+// LUMINO_PROFILE_FRAMES frames are kept for percentiles, CSV dumps and the
+// on-screen graph. Disabled profiling costs one NULL check per call.
+
+#define LUMINO_STAGE_CLEAR 0     // lumino_clear
+#define LUMINO_STAGE_DRAW 1      // everything between the clear (or last present) and lumino_present
+#define LUMINO_STAGE_UPSCALE 2   // upscale / palette conversion
+#define LUMINO_STAGE_UPLOAD 3    // SDL_UpdateTexture or the texture lock
+#define LUMINO_STAGE_PRESENT 4   // SDL_RenderClear + RenderCopy + RenderPresent (vsync waits land here)
+#define LUMINO_STAGE_FRAME 5     // present to present
+#define LUMINO_STAGE_COUNT 6
+
+#define LUMINO_PROFILE_FRAMES 256
+
+typedef struct lumino_profile lumino_profile;
+
+// Turn profiling on (allocates the history) or off (frees it)
+int lumino_profile_enable(LuminoRenderer* renderer, int enable);
+
+// Stage time in milliseconds at percentile pct (0..100) over the recorded
+// frames, 0 when nothing was recorded
+float lumino_profile_percentile(const LuminoRenderer* renderer, int stage, float pct);
+
+// Write the recorded frames, oldest first, as CSV (one row per frame, ms)
+int lumino_profile_write_csv(const LuminoRenderer* renderer, const char* path);
+
+// Draw the recent frame times as a stacked bar graph into the bottom of the
+// internal framebuffer, one column per frame, 1 pixel per ms, with a line at
+// 16.7 ms. Call it after drawing and before lumino_present; the indexed
+// mode has no 32-bit buffer to draw into, so it does nothing there.
+void lumino_profile_draw_overlay(LuminoRenderer* renderer);
+
+// Stage name as used in the CSV header
+const char* lumino_profile_stage_name(int stage);
+
+// Used by lumino.c: timestamps in ns, stage times accumulate until
+// lumino_profile_end_frame closes the frame
+uint64_t lumino_profile_now(void);
+void lumino_profile_add(lumino_profile* profile, int stage, uint64_t start, uint64_t end);
+void lumino_profile_end_frame(lumino_profile* profile, uint64_t present_start, uint64_t present_end);
+void lumino_profile_destroy(lumino_profile* profile);
+
+#endif // __PROFILE_H__
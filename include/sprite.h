@@ -3,11 +3,31 @@
 
 #include "lumino.h"
 
+// Run kinds of a precompiled sprite row
+#define LUMINO_RUN_SKIP 0    // alpha == 0, nothing to draw
+#define LUMINO_RUN_OPAQUE 1  // alpha == 255, straight copy
+#define LUMINO_RUN_BLEND 2   // translucent, alpha blended
+
+typedef struct {
+    uint16_t kind;      // LUMINO_RUN_*
+    uint16_t length;    // pixels in the run
+} lumino_sprite_run;
+
+// Every sprite row encoded as consecutive runs covering the full width.
+// Runs of row r are runs[row_start[r] .. row_start[r + 1]).
+typedef struct {
+    int* row_start;
+    lumino_sprite_run* runs;
+    int run_count;
+} lumino_sprite_runs;
+
 typedef struct {
     int width;
     int height;
     int x, y, z;        // Position in world space
-    lumino_color* data; // Pointer to the sprite data (RGBA)
+    uint32_t* data;     // Pointer to the sprite data, packed like the framebuffer (lumino_get_color)
+    uint8_t* index_data; // Palette indices (0 = transparent), only for lumino_load_png_indexed
+    lumino_sprite_runs* runs; // Skip/opaque/blend runs built by lumino_load_png, NULL if absent
 } lumino_sprite;
 
 // Function prototypes
@@ -15,16 +35,48 @@ typedef struct {
 // Load a PNG image and convert it to a sprite
 lumino_sprite lumino_load_png(LuminoRenderer* renderer, const char* filename);
 
+// Load a PNG image and quantize it into the renderer's palette, 1 byte per pixel.
+// Transparent pixels become index 0, new colors are added to the palette while
+// it has room, after that every pixel maps to its nearest palette entry.
+// The result only has index_data (data is NULL) and is drawn with lumino_draw_sprite_index.
+lumino_sprite lumino_load_png_indexed(LuminoRenderer* renderer, const char* filename);
+
+// Encode a sprite's rows as skip/opaque/blend runs (one allocation, release with free).
+// lumino_load_png already does this; call it again after editing sprite->data.
+lumino_sprite_runs* lumino_sprite_build_runs(const lumino_sprite* sprite);
+
+// Free the pixel data of a sprite loaded by any lumino_load_png* function
+void lumino_sprite_free(lumino_sprite* sprite);
+
 // Draw a sprite at a specific position
 // The sprite is drawn at the top-left corner (x, y)
 void lumino_draw_sprite(LuminoRenderer* renderer, lumino_sprite sprite);
 
+// Alpha-blended draw. Uses the sprite's runs when present: opaque runs are
+// copied, transparent ones skipped and only translucent pixels are blended.
 void lumino_draw_sprite_blend(LuminoRenderer* renderer, lumino_sprite sprite);
 
+// Draw an indexed sprite into the index buffer (LUMINO_FLAG_INDEXED), index 0 is skipped
+void lumino_draw_sprite_index(LuminoRenderer* renderer, lumino_sprite sprite);
+
 // Draw a sprite with lighting
 void lumino_draw_sprite_lit(LuminoRenderer* R,
                             lumino_sprite sprite,
                             lumino_light light,
                             float ambient);
 
+// Lights shared by every lightmapped blit: up to LUMINO_MAX_LIGHTS (disabled
+// ones are skipped) over an ambient level, 1.0 = unlit. In deferred mode the
+// draws recorded so far are flushed first, so they keep the previous lights.
+// Returns LUMINO_FAILURE when count is over the limit (the first
+// LUMINO_MAX_LIGHTS are kept).
+int lumino_set_lights(LuminoRenderer* R, const lumino_light* lights, int count, float ambient);
+
+// Draw a sprite multiplied by the lightmap: ambient plus the same point light
+// falloff as lumino_draw_sprite_lit, summed over all lights. The lightmap is
+// accumulated once at internal resolution on the first call after
+// lumino_set_lights, so every blit after that costs one multiply per channel.
+// Transparent pixels are skipped, the rest are written with their alpha.
+void lumino_draw_sprite_lightmap(LuminoRenderer* R, lumino_sprite sprite);
+
 #endif // __SPRITE_H__
\ No newline at end of file
@@ -0,0 +1,30 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <SDL.h>
+
+// A small fixed-size worker pool. lumino_pool_run hands out job indices
+// [0, count) to the workers and the calling thread, and returns once every
+// job has finished. Jobs are grabbed one index at a time from a shared
+// counter, so uneven jobs balance themselves.
+
+typedef void (*lumino_job_fn)(void* ctx, int index);
+
+typedef struct lumino_thread_pool lumino_thread_pool;
+
+// Create a pool that runs jobs on thread_count threads in total (the calling
+// thread included, so thread_count - 1 workers are spawned).
+// Returns NULL when thread_count <= 1 or when thread creation fails.
+lumino_thread_pool* lumino_pool_create(int thread_count);
+
+// Stop and join all workers
+void lumino_pool_destroy(lumino_thread_pool* pool);
+
+// Run fn(ctx, i) for every i in [0, count); blocks until all are done.
+// A NULL pool runs the jobs inline on the calling thread.
+void lumino_pool_run(lumino_thread_pool* pool, lumino_job_fn fn, void* ctx, int count);
+
+// Number of threads that execute jobs (workers + caller), 1 for a NULL pool
+int lumino_pool_thread_count(const lumino_thread_pool* pool);
+
+#endif // __THREADPOOL_H__
@@ -3,15 +3,33 @@
 
 #ifdef __ARM_NEON__
 #include <arm_neon.h>
-#include "lumino.h"
+#elif defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
 #endif
 #include <stdint.h>
 
-void copyBuffer(uint32_t* dst, const uint32_t* src, int w, int h);
-void upscale2x(uint32_t* dst, const uint32_t* src, int w, int h);
-void upscale4x(uint32_t* dst, const uint32_t* src, int w, int h);
-void upscale8x(uint32_t* dst, const uint32_t* src, int w, int h);
+// All upscalers share one signature so LuminoRenderer.upscale_fn can hold any
+// of them. n is the integer scale factor; the fixed-factor kernels ignore it.
+// dst_stride is the destination row length in pixels (>= w * n), so dst can be
+// a locked texture with padded rows. dst is only ever written, never read.
+// src_stride (>= w) is the source row length in pixels, so src can be a padded
+// framebuffer or a rectangle inside one.
+typedef void (*lumino_upscale_fn)(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h, int n);
 
+void copyBuffer(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h, int n);
+void upscale2x(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h, int n);
+void upscale4x(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h, int n);
+void upscale8x(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h, int n);
+void upscaleNx(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h, int n);
+
+// Look up N 8-bit indices in a 256-entry packed palette (all 256 entries must
+// be readable, unused ones zeroed)
 void palette_convert(uint32_t* dst, const uint8_t* src,const uint32_t* palette, int N);
 
+// Fused palette lookup + integer-n upscale of a w x h index image into dst
+// (dst_stride in pixels, src_stride in bytes). Indices are read once and the
+// 32-bit colors never round-trip through an internal framebuffer.
+void palette_upscale(uint32_t* dst, int dst_stride, const uint8_t* src, int src_stride,
+                     const uint32_t* palette, int w, int h, int n);
+
 #endif // __UPSCALE_H__
\ No newline at end of file
@@ -0,0 +1,106 @@
+// arena.c - 64-byte aligned bump allocator for frame and renderer scratch
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct lumino_arena_block {
+    lumino_arena_block* prev;            // older block in the chain
+    uint8_t* data;                       // first aligned byte after the header
+    size_t size;                         // usable bytes at data
+    size_t offset;                       // bytes handed out from this block
+};
+
+static inline size_t align_up(size_t n) {
+    return (n + LUMINO_ARENA_ALIGN - 1) & ~(size_t)(LUMINO_ARENA_ALIGN - 1);
+}
+
+static lumino_arena_block* block_create(lumino_arena* arena, size_t size) {
+    // over-allocate so data can be rounded up to the alignment
+    lumino_arena_block* block = (lumino_arena_block*)malloc(sizeof(lumino_arena_block) + LUMINO_ARENA_ALIGN - 1 + size);
+    if (!block) {
+        return NULL;
+    }
+    arena->heap_allocations++;
+    block->data = (uint8_t*)(uintptr_t)align_up((size_t)(uintptr_t)(block + 1));
+    block->size = size;
+    block->offset = 0;
+    block->prev = NULL;
+    return block;
+}
+
+void lumino_arena_init(lumino_arena* arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = align_up(block_size);
+    arena->used = 0;
+    arena->peak = 0;
+    arena->heap_allocations = 0;
+}
+
+void* lumino_arena_alloc(lumino_arena* arena, size_t size) {
+    // sizes stay multiples of the alignment, so every offset is aligned
+    size = align_up(size);
+
+    lumino_arena_block* head = arena->head;
+    if (!head || head->size - head->offset < size) {
+        // grow geometrically so a long frame doesn't chain hundreds of blocks
+        size_t block_size = head ? head->size * 2 : arena->block_size;
+        if (block_size < size) block_size = size;
+
+        lumino_arena_block* block = block_create(arena, block_size);
+        if (!block) {
+            return NULL;
+        }
+        block->prev = head;
+        arena->head = head = block;
+    }
+
+    void* p = head->data + head->offset;
+    head->offset += size;
+    arena->used += size;
+    return p;
+}
+
+void* lumino_arena_calloc(lumino_arena* arena, size_t count, size_t size) {
+    if (size && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void* p = lumino_arena_alloc(arena, count * size);
+    if (p) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void lumino_arena_reset(lumino_arena* arena) {
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    arena->used = 0;
+
+    lumino_arena_block* head = arena->head;
+    if (head && head->prev) {
+        // the frame overflowed into several blocks: replace them with one
+        // that holds them all, so the next frame fits without allocating
+        size_t total = 0;
+        for (lumino_arena_block* b = head; b; b = b->prev) {
+            total += b->size;
+        }
+        lumino_arena_destroy(arena);
+        arena->head = block_create(arena, total);
+        return;
+    }
+    if (head) {
+        head->offset = 0;
+    }
+}
+
+void lumino_arena_destroy(lumino_arena* arena) {
+    lumino_arena_block* block = arena->head;
+    while (block) {
+        lumino_arena_block* prev = block->prev;
+        free(block);
+        block = prev;
+    }
+    arena->head = NULL;
+}
@@ -1,39 +1,296 @@
+// benchmarks.c - headless microbenchmarks for the drawing and upscale kernels
+
 #include "benchmarks.h"
+#include "sprite.h"
+#include "upscale.h"
+#include "dispatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_WARMUP_NS   20000000ull   // per case and level, also calibrates the batch size
+#define BENCH_SAMPLE_NS    2000000ull   // target duration of one timed sample
+#define BENCH_SAMPLES     15            // median of this many samples is reported
+#define BENCH_LINES       64
+#define BENCH_SPRITE_SIZE 64
+
+typedef struct {
+    LuminoRenderer renderer;             // headless, upscale factor 1
+    uint32_t* upscale_dst;               // room for the largest upscale (8x)
+    lumino_sprite sprite;                // mix of transparent, opaque and translucent pixels
+    lumino_light light;
+    lumino_light light_moved;            // light one pixel over, the lightmap build alternates the two
+    int light_flip;
+    int lines[BENCH_LINES][4];
+    int line_pixels;                     // pixels touched by one pass over lines
+} bench_ctx;
+
+typedef struct {
+    const char* name;
+    void (*run)(bench_ctx* c);
+    double (*pixels)(const bench_ctx* c);  // pixels produced per run
+    double bytes_per_pixel;                // memory traffic per produced pixel
+} bench_case;
+
+//-----------------------------------------------------------------------------
+// Cases
+//-----------------------------------------------------------------------------
+
+static void run_upscale(bench_ctx* c, lumino_upscale_fn fn, int n) {
+    LuminoRenderer* r = &c->renderer;
+    fn(c->upscale_dst, r->internal_width * n, r->internal_framebuffer, r->stride,
+       r->internal_width, r->internal_height, n);
+}
+
+static void run_upscale1x(bench_ctx* c) { run_upscale(c, copyBuffer, 1); }
+static void run_upscale2x(bench_ctx* c) { run_upscale(c, upscale2x, 2); }
+static void run_upscale4x(bench_ctx* c) { run_upscale(c, upscale4x, 4); }
+static void run_upscale8x(bench_ctx* c) { run_upscale(c, upscale8x, 8); }
+
+static void run_fill(bench_ctx* c) {
+    LuminoRenderer* r = &c->renderer;
+    lumino_fill_rectangle(r, 0, 0, r->internal_width, r->internal_height, (lumino_color){200, 100, 50, 255});
+}
+
+static void run_fill_blend(bench_ctx* c) {
+    LuminoRenderer* r = &c->renderer;
+    lumino_fill_rectangle_blend(r, 0, 0, r->internal_width, r->internal_height, (lumino_color){200, 100, 50, 128});
+}
+
+static void run_lines(bench_ctx* c) {
+    for (int i = 0; i < BENCH_LINES; i++) {
+        lumino_draw_line(&c->renderer, c->lines[i][0], c->lines[i][1], c->lines[i][2], c->lines[i][3],
+                         (lumino_color){255, 255, 255, 255});
+    }
+}
+
+// sprites are drawn on a grid covering the whole framebuffer
+static void run_sprites(bench_ctx* c, int mode) {
+    LuminoRenderer* r = &c->renderer;
+    lumino_sprite s = c->sprite;
+    if (mode == 2) s.runs = NULL;  // span blend instead of the RLE runs
+    for (s.y = 0; s.y + s.height <= r->internal_height; s.y += s.height) {
+        for (s.x = 0; s.x + s.width <= r->internal_width; s.x += s.width) {
+            switch (mode) {
+                case 0: lumino_draw_sprite(r, s); break;
+                case 1:
+                case 2: lumino_draw_sprite_blend(r, s); break;
+                case 3: lumino_draw_sprite_lit(r, s, c->light, 0.2f); break;
+                default: lumino_draw_sprite_lightmap(r, s); break;
+            }
+        }
+    }
+}
+
+static void run_sprite_copy(bench_ctx* c)  { run_sprites(c, 0); }
+static void run_sprite_blend(bench_ctx* c) { run_sprites(c, 1); }
+static void run_sprite_span(bench_ctx* c)  { run_sprites(c, 2); }
+static void run_sprite_lit(bench_ctx* c)   { run_sprites(c, 3); }
+static void run_sprite_lightmap(bench_ctx* c) { run_sprites(c, 4); }
+
+// the whole lightmap pass, as after every lumino_set_lights: switching
+// between two light sets makes the next lightmapped blit rebuild it
+static void run_lightmap_build(bench_ctx* c) {
+    LuminoRenderer* r = &c->renderer;
+    c->light_flip ^= 1;
+    lumino_set_lights(r, c->light_flip ? &c->light_moved : &c->light, 1, 0.2f);
+    lumino_sprite s = c->sprite;
+    s.x = s.y = 0;
+    lumino_draw_sprite_lightmap(r, s);
+}
+
+static void run_palette_convert(bench_ctx* c) {
+    LuminoRenderer* r = &c->renderer;
+    palette_convert(r->internal_framebuffer, r->index_buffer, r->palette_argb,
+                    r->internal_width * r->internal_height);
+}
+
+static double internal_pixels(const bench_ctx* c) {
+    return (double)c->renderer.internal_width * c->renderer.internal_height;
+}
+static double upscaled2x_pixels(const bench_ctx* c) { return internal_pixels(c) * 4; }
+static double upscaled4x_pixels(const bench_ctx* c) { return internal_pixels(c) * 16; }
+static double upscaled8x_pixels(const bench_ctx* c) { return internal_pixels(c) * 64; }
+static double line_pixels(const bench_ctx* c) { return c->line_pixels; }
+static double sprite_pixels(const bench_ctx* c) {
+    const LuminoRenderer* r = &c->renderer;
+    return (double)(r->internal_width / c->sprite.width) * (r->internal_height / c->sprite.height) *
+           c->sprite.width * c->sprite.height;
+}
+
+// Traffic per output pixel: an upscale by n reads 4 / n^2 source bytes and
+// writes 4, a blend reads and writes the destination, sprites also read their
+// own data and the palette conversion reads 1 index per pixel. Lightmapped
+// sprites read 8 bytes of light factors on top, the build writes them.
+static const bench_case bench_cases[] = {
+    { "upscale 1x",      run_upscale1x,       internal_pixels,   8.0 },
+    { "upscale 2x",      run_upscale2x,       upscaled2x_pixels, 4.0 + 4.0 / 4 },
+    { "upscale 4x",      run_upscale4x,       upscaled4x_pixels, 4.0 + 4.0 / 16 },
+    { "upscale 8x",      run_upscale8x,       upscaled8x_pixels, 4.0 + 4.0 / 64 },
+    { "fill rect",       run_fill,            internal_pixels,   4.0 },
+    { "fill rect blend", run_fill_blend,      internal_pixels,   8.0 },
+    { "lines",           run_lines,           line_pixels,       4.0 },
+    { "sprite copy",     run_sprite_copy,     sprite_pixels,     8.0 },
+    { "sprite blend",    run_sprite_blend,    sprite_pixels,     12.0 },
+    { "sprite blend span", run_sprite_span,   sprite_pixels,     12.0 },
+    { "sprite lit",      run_sprite_lit,      sprite_pixels,     12.0 },
+    { "sprite lightmap", run_sprite_lightmap, sprite_pixels,     20.0 },
+    { "lightmap build",  run_lightmap_build,  internal_pixels,   8.0 },
+    { "palette convert", run_palette_convert, internal_pixels,   5.0 },
+};
+
+static const int bench_sizes[][2] = { { 160, 120 }, { 320, 240 }, { 640, 480 } };
+
+//-----------------------------------------------------------------------------
+// Setup
+//-----------------------------------------------------------------------------
+
+static int bench_setup(bench_ctx* c, int width, int height) {
+    memset(c, 0, sizeof(*c));
+    if (lumino_init_headless(&c->renderer, 1, width, height, LUMINO_FLAG_INDEXED) != LUMINO_SUCCESS) {
+        return LUMINO_FAILURE;
+    }
+    LuminoRenderer* r = &c->renderer;
+
+    c->upscale_dst = (uint32_t*)malloc((size_t)width * height * 64 * sizeof(uint32_t));
+    c->sprite.width = c->sprite.height = BENCH_SPRITE_SIZE;
+    c->sprite.data = (uint32_t*)malloc(BENCH_SPRITE_SIZE * BENCH_SPRITE_SIZE * sizeof(uint32_t));
+    if (!c->upscale_dst || !c->sprite.data) {
+        return LUMINO_FAILURE;
+    }
+
+    srand(1234);
+    for (int i = 0; i < r->stride * height; i++) {
+        r->internal_framebuffer[i] = ((uint32_t)rand() << 8) ^ (uint32_t)rand();
+        r->index_buffer[i] = (uint8_t)rand();
+    }
+    for (int i = 1; i < 256; i++) {
+        lumino_add_palette_color(r, rand(), rand(), rand(), 255);
+    }
+
+    // a disc: opaque core, translucent rim, transparent corners
+    int half = BENCH_SPRITE_SIZE / 2;
+    for (int y = 0; y < BENCH_SPRITE_SIZE; y++) {
+        for (int x = 0; x < BENCH_SPRITE_SIZE; x++) {
+            int d2 = (x - half) * (x - half) + (y - half) * (y - half);
+            uint8_t a = d2 < (half - 8) * (half - 8) ? 255 : (d2 < half * half ? 128 : 0);
+            c->sprite.data[y * BENCH_SPRITE_SIZE + x] = lumino_get_color((lumino_color){x * 4, y * 4, 128, a});
+        }
+    }
+    c->sprite.runs = lumino_sprite_build_runs(&c->sprite);
+
+    c->light.x = width / 2;
+    c->light.y = height / 2;
+    c->light.color = (lumino_color){255, 200, 150, 255};
+    c->light.intensity = 0.8f;
+    c->light.range = width / 2;
+    c->light.inv_range_sq = 1.0f / (c->light.range * c->light.range);
+    c->light.enabled = 1;
+    c->light_moved = c->light;
+    c->light_moved.x += 1;
+    lumino_set_lights(r, &c->light, 1, 0.2f);
+
+    c->line_pixels = 0;
+    for (int i = 0; i < BENCH_LINES; i++) {
+        int* l = c->lines[i];
+        l[0] = rand() % width;
+        l[1] = rand() % height;
+        l[2] = rand() % width;
+        l[3] = rand() % height;
+        int dx = abs(l[2] - l[0]), dy = abs(l[3] - l[1]);
+        c->line_pixels += (dx > dy ? dx : dy) + 1;
+    }
+    return LUMINO_SUCCESS;
+}
+
+static void bench_teardown(bench_ctx* c) {
+    free(c->upscale_dst);
+    lumino_sprite_free(&c->sprite);
+    lumino_shutdown(&c->renderer);
+}
+
+//-----------------------------------------------------------------------------
+// Timing
+//-----------------------------------------------------------------------------
+
+static uint64_t bench_now_ns(void) {
+    static uint64_t freq = 0;
+    if (!freq) freq = SDL_GetPerformanceFrequency();
+    uint64_t t = SDL_GetPerformanceCounter();
+    return (t / freq) * 1000000000ull + (t % freq) * 1000000000ull / freq;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Median time of one run in ns. Warmup runs until BENCH_WARMUP_NS has passed
+// and sizes the batch so each timed sample takes about BENCH_SAMPLE_NS.
+static double bench_measure(const bench_case* bc, bench_ctx* c) {
+    uint64_t start = bench_now_ns();
+    uint64_t runs = 0;
+    uint64_t elapsed;
+    do {
+        bc->run(c);
+        runs++;
+        elapsed = bench_now_ns() - start;
+    } while (elapsed < BENCH_WARMUP_NS);
+
+    uint64_t batch = runs * BENCH_SAMPLE_NS / elapsed;
+    if (batch < 1) batch = 1;
+
+    double samples[BENCH_SAMPLES];
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        uint64_t t0 = bench_now_ns();
+        for (uint64_t i = 0; i < batch; i++) {
+            bc->run(c);
+        }
+        samples[s] = (double)(bench_now_ns() - t0) / batch;
+    }
+    qsort(samples, BENCH_SAMPLES, sizeof(double), compare_double);
+    return samples[BENCH_SAMPLES / 2];
+}
+
+//-----------------------------------------------------------------------------
+// Driver
+//-----------------------------------------------------------------------------
+
+int lumino_run_benchmarks(const char* filter) {
+    int default_level = lumino_dispatch_level();
+    int case_count = (int)(sizeof(bench_cases) / sizeof(bench_cases[0]));
+    int size_count = (int)(sizeof(bench_sizes) / sizeof(bench_sizes[0]));
+
+    printf("%-18s %-9s %-7s %10s %9s %8s\n", "kernel", "size", "simd", "ns/pixel", "GB/s", "speedup");
+    for (int s = 0; s < size_count; s++) {
+        bench_ctx ctx;
+        if (bench_setup(&ctx, bench_sizes[s][0], bench_sizes[s][1]) != LUMINO_SUCCESS) {
+            fprintf(stderr, "benchmark setup failed for %dx%d\n", bench_sizes[s][0], bench_sizes[s][1]);
+            return LUMINO_FAILURE;
+        }
+
+        for (int k = 0; k < case_count; k++) {
+            const bench_case* bc = &bench_cases[k];
+            if (filter && !strstr(bc->name, filter)) continue;
+
+            double scalar_ns = 0;
+            for (int level = LUMINO_SIMD_SCALAR; level <= LUMINO_SIMD_NEON; level++) {
+                // every level this CPU can run, scalar first as the baseline
+                if (lumino_dispatch_select(level) != LUMINO_SUCCESS) continue;
+
+                double ns = bench_measure(bc, &ctx);
+                double pixels = bc->pixels(&ctx);
+                if (level == LUMINO_SIMD_SCALAR) scalar_ns = ns;
 
+                char size[16];
+                snprintf(size, sizeof(size), "%dx%d", bench_sizes[s][0], bench_sizes[s][1]);
+                printf("%-18s %-9s %-7s %10.3f %9.2f %7.2fx\n", bc->name, size, lumino_dispatch_name(level),
+                       ns / pixels, pixels * bc->bytes_per_pixel / ns, scalar_ns / ns);
+            }
+        }
+        bench_teardown(&ctx);
+    }
 
-//void benchmark_lines(LuminoRenderer* r) {
-//    const int N = 10;
-//    uint32_t start, end;
-//
-//    // Warm-up
-//    for (int i = 0; i < 100; ++i) {
-//        lumino_draw_line(r, rand() % r->internal_width - 1, rand() % r->internal_height - 1,
-//                            rand() % r->internal_width - 1, rand() % r->internal_height - 1, 3);
-//    }
-//
-//    
-//    // -------------------------
-//    // Scalar version benchmark
-//    // -------------------------
-//    start = SDL_GetTicks();
-//    for (int i = 0; i < N; ++i) {
-//        lumino_draw_line_scalar(r, rand() % r->internal_width, rand() % r->internal_height,
-//                            rand() % r->internal_width, rand() % r->internal_height, 3);
-//    }
-//    end = SDL_GetTicks();
-//    printf("Scalar Bresenham: %d ms for %d lines\n", end - start, N);
-//
-//    // Clear the buffer between runs if needed
-//    lumino_clear(r);
-//
-//    // -------------------------
-//    // NEON version benchmark
-//    // -------------------------
-//    start = SDL_GetTicks();
-//    for (int i = 0; i < N; ++i) {
-//        lumino_draw_line_neon(r, rand() % r->internal_width, rand() % r->internal_height,
-//                                 rand() % r->internal_width, rand() % r->internal_height, 3);
-//    }
-//    end = SDL_GetTicks();
-//    printf("NEON float line:  %d ms for %d lines\n", end - start, N);
-//}
\ No newline at end of file
+    lumino_dispatch_select(default_level);
+    return LUMINO_SUCCESS;
+}
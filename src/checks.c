@@ -0,0 +1,573 @@
+// checks.c - headless correctness checks for the kernels, see checks.h
+
+#include "checks.h"
+#include "dispatch.h"
+#include "sprite.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK_WIDTH  157   // odd sizes above the 100 pixel minimum, so rows end off any SIMD width
+#define CHECK_HEIGHT 113
+#define CHECK_ROUNDS 200
+#define CHECK_FRAMES 30
+#define CHECK_SPRITE 24
+
+typedef struct {
+    const char* name;
+    int (*run)(int level);  // number of wrong pixels at this SIMD level
+} check_case;
+
+//-----------------------------------------------------------------------------
+// Helpers
+//-----------------------------------------------------------------------------
+
+// xorshift32, so the scenes don't depend on the libc rand()
+static uint32_t check_rand(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static int check_range(uint32_t* state, int lo, int hi) {
+    return lo + (int)(check_rand(state) % (uint32_t)(hi - lo + 1));
+}
+
+// mostly translucent, with the 0 and 255 shortcuts mixed in
+static uint8_t check_alpha(uint32_t* state) {
+    switch (check_rand(state) % 8) {
+        case 0: return 0;
+        case 1: return 255;
+        default: return (uint8_t)check_rand(state);
+    }
+}
+
+static void check_noise(LuminoRenderer* r, uint32_t* state) {
+    for (int i = 0; i < r->stride * r->internal_height; i++) {
+        r->internal_framebuffer[i] = check_rand(state);
+    }
+}
+
+// A disc with an opaque core, translucent rim and transparent corners, in
+// both the RGBA and the indexed form, freed with lumino_sprite_free
+static int check_sprite(lumino_sprite* s) {
+    memset(s, 0, sizeof(*s));
+    s->width = s->height = CHECK_SPRITE;
+    s->data = (uint32_t*)malloc(CHECK_SPRITE * CHECK_SPRITE * sizeof(uint32_t));
+    s->index_data = (uint8_t*)malloc(CHECK_SPRITE * CHECK_SPRITE);
+    if (!s->data || !s->index_data) return LUMINO_FAILURE;
+
+    int half = CHECK_SPRITE / 2;
+    for (int y = 0; y < CHECK_SPRITE; y++) {
+        for (int x = 0; x < CHECK_SPRITE; x++) {
+            int d2 = (x - half) * (x - half) + (y - half) * (y - half);
+            uint8_t a = d2 < (half - 4) * (half - 4) ? 255 : (d2 < half * half ? 100 : 0);
+            s->data[y * CHECK_SPRITE + x] = lumino_get_color((lumino_color){x * 10, y * 10, 128, a});
+            s->index_data[y * CHECK_SPRITE + x] = a ? (uint8_t)(1 + (x + y) % 5) : 0;
+        }
+    }
+    s->runs = lumino_sprite_build_runs(s);
+    return s->runs ? LUMINO_SUCCESS : LUMINO_FAILURE;
+}
+
+// Both renderers start from the same noise and palette
+static void check_init_pair(LuminoRenderer* r[2], uint32_t seed) {
+    for (int i = 0; i < 2; i++) {
+        uint32_t state = seed;
+        check_noise(r[i], &state);
+        if (r[i]->index_buffer) {
+            for (int p = 0; p < r[i]->stride * r[i]->internal_height; p++) {
+                r[i]->index_buffer[p] = (uint8_t)(check_rand(&state) % 6);
+            }
+        }
+        for (int c = 1; c < 6; c++) {
+            lumino_add_palette_color(r[i], c * 40, c * 7, 200, 255);
+        }
+    }
+}
+
+// Pixels of the internal buffer (indices in indexed mode) that differ
+static int check_compare(const LuminoRenderer* a, const LuminoRenderer* b) {
+    int wrong = 0;
+    for (int y = 0; y < a->internal_height; y++) {
+        for (int x = 0; x < a->internal_width; x++) {
+            size_t i = (size_t)y * a->stride + x;
+            wrong += a->index_buffer ? a->index_buffer[i] != b->index_buffer[i]
+                                     : a->internal_framebuffer[i] != b->internal_framebuffer[i];
+        }
+    }
+    return wrong;
+}
+
+//-----------------------------------------------------------------------------
+// Checks
+//-----------------------------------------------------------------------------
+
+// Blend fills, partly off screen, against lumino_blend_packed per pixel
+static int check_fill_blend(int level) {
+    (void)level;
+    LuminoRenderer r;
+    if (lumino_init_headless(&r, 1, CHECK_WIDTH, CHECK_HEIGHT, 0) != LUMINO_SUCCESS) return -1;
+    uint32_t* ref = (uint32_t*)malloc((size_t)r.stride * CHECK_HEIGHT * sizeof(uint32_t));
+    if (!ref) {
+        lumino_shutdown(&r);
+        return -1;
+    }
+
+    uint32_t state = 0x9E3779B9u;
+    check_noise(&r, &state);
+    memcpy(ref, r.internal_framebuffer, (size_t)r.stride * CHECK_HEIGHT * sizeof(uint32_t));
+
+    for (int i = 0; i < CHECK_ROUNDS; i++) {
+        int x = check_range(&state, -24, CHECK_WIDTH);
+        int y = check_range(&state, -24, CHECK_HEIGHT);
+        int w = check_range(&state, 0, 48);
+        int h = check_range(&state, 0, 24);
+        uint32_t rgb = check_rand(&state);
+        lumino_color color = { (uint8_t)rgb, (uint8_t)(rgb >> 8), (uint8_t)(rgb >> 16), check_alpha(&state) };
+
+        lumino_fill_rectangle_blend(&r, x, y, w, h, color);
+
+        uint32_t packed = lumino_get_color(color);
+        for (int yy = y; yy < y + h; yy++) {
+            for (int xx = x; xx < x + w; xx++) {
+                if (xx < 0 || xx >= CHECK_WIDTH || yy < 0 || yy >= CHECK_HEIGHT) continue;
+                uint32_t* p = &ref[yy * r.stride + xx];
+                *p = lumino_blend_packed(*p, packed);
+            }
+        }
+    }
+
+    int wrong = 0;
+    for (int y = 0; y < CHECK_HEIGHT; y++) {
+        for (int x = 0; x < CHECK_WIDTH; x++) {
+            wrong += r.internal_framebuffer[y * r.stride + x] != ref[y * r.stride + x];
+        }
+    }
+    free(ref);
+    lumino_shutdown(&r);
+    return wrong;
+}
+
+// Blended sprites, with and without runs and partly off screen, against
+// lumino_blend_packed per pixel: SIMD lanes and scalar tails must agree
+static int check_sprite_blend(int level) {
+    (void)level;
+    LuminoRenderer r;
+    lumino_sprite sprite;
+    if (check_sprite(&sprite) != LUMINO_SUCCESS ||
+        lumino_init_headless(&r, 1, CHECK_WIDTH, CHECK_HEIGHT, 0) != LUMINO_SUCCESS) {
+        lumino_sprite_free(&sprite);
+        return -1;
+    }
+    size_t size = (size_t)r.stride * CHECK_HEIGHT * sizeof(uint32_t);
+    uint32_t* ref = (uint32_t*)malloc(size);
+    uint32_t state = 0x27D4EB2Fu;
+    for (int i = 0; i < CHECK_SPRITE * CHECK_SPRITE; i++) {
+        sprite.data[i] = (check_rand(&state) & 0x00FFFFFF) | ((uint32_t)check_alpha(&state) << 24);
+    }
+    free(sprite.runs);
+    sprite.runs = lumino_sprite_build_runs(&sprite);
+
+    int wrong = -1;
+    if (ref && sprite.runs) {
+        check_noise(&r, &state);
+        memcpy(ref, r.internal_framebuffer, size);
+        for (int i = 0; i < CHECK_ROUNDS; i++) {
+            lumino_sprite s = sprite;
+            s.x = check_range(&state, -CHECK_SPRITE, CHECK_WIDTH);
+            s.y = check_range(&state, -CHECK_SPRITE, CHECK_HEIGHT);
+            if (i & 1) s.runs = NULL;
+            lumino_draw_sprite_blend(&r, s);
+
+            for (int y = 0; y < CHECK_SPRITE; y++) {
+                for (int x = 0; x < CHECK_SPRITE; x++) {
+                    int xx = s.x + x, yy = s.y + y;
+                    if (xx < 0 || xx >= CHECK_WIDTH || yy < 0 || yy >= CHECK_HEIGHT) continue;
+                    uint32_t* p = &ref[yy * r.stride + xx];
+                    *p = lumino_blend_packed(*p, s.data[y * CHECK_SPRITE + x]);
+                }
+            }
+        }
+        wrong = 0;
+        for (int y = 0; y < CHECK_HEIGHT; y++) {
+            for (int x = 0; x < CHECK_WIDTH; x++) {
+                wrong += r.internal_framebuffer[y * r.stride + x] != ref[y * r.stride + x];
+            }
+        }
+    }
+    free(ref);
+    lumino_sprite_free(&sprite);
+    lumino_shutdown(&r);
+    return wrong;
+}
+
+// One random draw, the same on both renderers
+static void check_draw(LuminoRenderer* r[2], uint32_t* state) {
+    int x = check_range(state, -16, CHECK_WIDTH - 1);
+    int y = check_range(state, -16, CHECK_HEIGHT - 1);
+    int w = check_range(state, 1, 32);
+    int h = check_range(state, 1, 32);
+    uint32_t rgb = check_rand(state);
+    lumino_color color = { (uint8_t)rgb, (uint8_t)(rgb >> 8), (uint8_t)(rgb >> 16), check_alpha(state) };
+    int op = check_range(state, 0, 2);
+
+    for (int i = 0; i < 2; i++) {
+        if (r[i]->index_buffer) {
+            if (op == 0) lumino_draw_pixel_index(r[i], x, y, (uint8_t)rgb);
+            else lumino_fill_rectangle_index(r[i], x, y, w, h, (uint8_t)rgb);
+        } else if (op == 0) {
+            lumino_draw_pixel(r[i], x, y, color);
+        } else if (op == 1) {
+            lumino_fill_rectangle_blend(r[i], x, y, w, h, color);
+        } else {
+            // the plain fill expects an on-screen rect
+            int cx = x < 0 ? 0 : x, cy = y < 0 ? 0 : y;
+            int cw = cx + w > CHECK_WIDTH ? CHECK_WIDTH - cx : w;
+            int ch = cy + h > CHECK_HEIGHT ? CHECK_HEIGHT - cy : h;
+            lumino_fill_rectangle(r[i], cx, cy, cw, ch, color);
+        }
+    }
+}
+
+// Frames with and without LUMINO_FLAG_DIRTY_RECTS must present the same
+// pixels, including frames that skip lumino_clear and clears after drawing
+static int check_dirty_rects_mode(int flags) {
+    LuminoRenderer full, dirty;
+    LuminoRenderer* r[2] = { &full, &dirty };
+    if (lumino_init_headless(&full, 2, CHECK_WIDTH, CHECK_HEIGHT, flags) != LUMINO_SUCCESS) return -1;
+    if (lumino_init_headless(&dirty, 2, CHECK_WIDTH, CHECK_HEIGHT, flags | LUMINO_FLAG_DIRTY_RECTS) != LUMINO_SUCCESS) {
+        lumino_shutdown(&full);
+        return -1;
+    }
+    uint32_t state = 0x2545F491u;
+    for (int i = 1; i < 256; i++) {
+        uint32_t rgb = check_rand(&state);
+        lumino_add_palette_color(&full, (uint8_t)rgb, (uint8_t)(rgb >> 8), (uint8_t)(rgb >> 16), 255);
+        lumino_add_palette_color(&dirty, (uint8_t)rgb, (uint8_t)(rgb >> 8), (uint8_t)(rgb >> 16), 255);
+    }
+
+    int wrong = 0;
+    lumino_clear(&full);
+    lumino_clear(&dirty);
+    for (int frame = 0; frame < CHECK_ROUNDS; frame++) {
+        if (check_range(&state, 0, 2) == 0) {
+            lumino_clear(&full);
+            lumino_clear(&dirty);
+        }
+        int draws = check_range(&state, 0, 4);
+        for (int i = 0; i < draws; i++) check_draw(r, &state);
+        if (check_range(&state, 0, 3) == 0) {
+            check_draw(r, &state);
+            lumino_clear(&full);
+            lumino_clear(&dirty);
+        }
+        lumino_present(&full);
+        lumino_present(&dirty);
+
+        for (int y = 0; y < full.height; y++) {
+            for (int x = 0; x < full.width; x++) {
+                wrong += full.framebuffer[y * full.framebuffer_stride + x] !=
+                         dirty.framebuffer[y * dirty.framebuffer_stride + x];
+            }
+        }
+    }
+    lumino_shutdown(&full);
+    lumino_shutdown(&dirty);
+    return wrong;
+}
+
+static int check_dirty_rects(int level) {
+    (void)level;
+    int rgba = check_dirty_rects_mode(0);
+    int indexed = check_dirty_rects_mode(LUMINO_FLAG_INDEXED);
+    return rgba < 0 || indexed < 0 ? -1 : rgba + indexed;
+}
+
+// A random scene of every deferrable draw, lines and sprites crossing the
+// edges and tile borders
+static void check_scene(LuminoRenderer* r, lumino_sprite sprite, uint32_t seed) {
+    uint32_t state = seed;
+    int w = r->internal_width, h = r->internal_height;
+    int draws = check_range(&state, 0, 60);
+    for (int i = 0; i < draws; i++) {
+        int x = check_range(&state, -20, w + 20);
+        int y = check_range(&state, -20, h + 20);
+        int x2 = check_range(&state, -40, w + 40);
+        int y2 = check_range(&state, -40, h + 40);
+        uint32_t rgb = check_rand(&state);
+        lumino_color color = { (uint8_t)rgb, (uint8_t)(rgb >> 8), (uint8_t)(rgb >> 16), check_alpha(&state) };
+        uint8_t index = (uint8_t)(rgb % 6);
+        sprite.x = x;
+        sprite.y = y;
+
+        int op = check_range(&state, 0, 9);
+        if (r->index_buffer) {
+            switch (op % 5) {
+                case 0: lumino_fill_rectangle_index(r, x, y, x2 & 63, y2 & 63, index); break;
+                case 1: lumino_draw_line_index(r, x, y, x2, y2, index); break;
+                case 2: lumino_draw_pixel_index(r, x, y, index); break;
+                case 3: lumino_draw_rectangle_index(r, x, y, x2 & 63, y2 & 63, index); break;
+                default: lumino_draw_sprite_index(r, sprite); break;
+            }
+            continue;
+        }
+        switch (op) {
+            case 0:
+            case 1: {
+                // the plain fill expects an on-screen rect
+                int fx = x < 0 ? 0 : (x >= w ? w - 1 : x), fy = y < 0 ? 0 : (y >= h ? h - 1 : y);
+                int fw = fx + (x2 & 63) > w ? w - fx : (x2 & 63);
+                int fh = fy + (y2 & 63) > h ? h - fy : (y2 & 63);
+                if (op == 0) lumino_fill_rectangle(r, fx, fy, fw, fh, color);
+                else lumino_fill_rectangle_blend(r, x, y, x2 & 63, y2 & 63, color);
+                break;
+            }
+            case 2: lumino_draw_line(r, x, y, x2, y2, color); break;
+            case 3: lumino_draw_line_blend(r, x, y, x2, y2, color); break;
+            case 4: lumino_draw_pixel(r, x, y, color); lumino_draw_pixel_blend(r, x + 1, y, color); break;
+            case 5: lumino_draw_sprite(r, sprite); break;
+            case 6: lumino_draw_sprite_blend(r, sprite); break;
+            case 7: sprite.runs = NULL; lumino_draw_sprite_blend(r, sprite); break;
+            case 8: {
+                lumino_light light = { 0 };
+                light.x = x2 + 0.25f;
+                light.y = y2 + 0.5f;
+                light.color = (lumino_color){ 255, 200, 150, 255 };
+                light.intensity = 0.8f;
+                light.range = 30.0f + (rgb & 31);
+                light.enabled = 1;
+                lumino_draw_sprite_lit(r, sprite, light, 0.2f);
+                break;
+            }
+            default: lumino_draw_rectangle(r, x, y, x2 & 63, y2 & 63, color); break;
+        }
+    }
+}
+
+// LUMINO_FLAG_DEFERRED against immediate drawing, RGBA and indexed, with
+// and without dirty rects: the internal buffer after every present and the
+// upscaled frame must match bit for bit
+static int check_deferred_mode(lumino_sprite sprite, int flags) {
+    LuminoRenderer immediate, deferred;
+    LuminoRenderer* r[2] = { &immediate, &deferred };
+    if (lumino_init_headless(&immediate, 2, CHECK_WIDTH, CHECK_HEIGHT, flags) != LUMINO_SUCCESS) return -1;
+    if (lumino_init_headless(&deferred, 2, CHECK_WIDTH, CHECK_HEIGHT, flags | LUMINO_FLAG_DEFERRED) != LUMINO_SUCCESS) {
+        lumino_shutdown(&immediate);
+        return -1;
+    }
+    check_init_pair(r, 0x1B873593u + flags);
+
+    int wrong = 0;
+    for (int frame = 0; frame < CHECK_FRAMES; frame++) {
+        if (frame % 3) {
+            lumino_clear(&immediate);
+            lumino_clear(&deferred);
+        }
+        check_scene(&immediate, sprite, 0xCC9E2D51u * (frame + 1));
+        check_scene(&deferred, sprite, 0xCC9E2D51u * (frame + 1));
+        lumino_present(&immediate);
+        lumino_present(&deferred);
+
+        wrong += check_compare(&immediate, &deferred);
+        for (int y = 0; y < immediate.height; y++) {
+            wrong += memcmp(immediate.framebuffer + (size_t)y * immediate.framebuffer_stride,
+                            deferred.framebuffer + (size_t)y * deferred.framebuffer_stride,
+                            immediate.width * sizeof(uint32_t)) != 0;
+        }
+    }
+    lumino_shutdown(&immediate);
+    lumino_shutdown(&deferred);
+    return wrong;
+}
+
+static int check_deferred(int level) {
+    (void)level;
+    lumino_sprite sprite;
+    int wrong = -1;
+    if (check_sprite(&sprite) == LUMINO_SUCCESS) {
+        wrong = 0;
+        for (int mode = 0; mode < 4 && wrong >= 0; mode++) {
+            int flags = (mode & 1 ? LUMINO_FLAG_INDEXED : 0) | (mode & 2 ? LUMINO_FLAG_DIRTY_RECTS : 0);
+            int n = check_deferred_mode(sprite, flags);
+            wrong = n < 0 ? -1 : wrong + n;
+        }
+    }
+    lumino_sprite_free(&sprite);
+    return wrong;
+}
+
+// Lightmapped blits over a frame that changes its lights halfway
+static void check_lightmap_scene(LuminoRenderer* r, lumino_sprite sprite, lumino_light* lights, int frame) {
+    uint32_t state = 0x85EBCA6Bu * (frame + 1);
+    lumino_clear(r);
+    lumino_set_lights(r, lights, 3, 0.2f + frame * 0.1f);
+    for (int i = 0; i < 40; i++) {
+        sprite.x = check_range(&state, -20, r->internal_width);
+        sprite.y = check_range(&state, -20, r->internal_height);
+        lumino_draw_sprite_lightmap(r, sprite);
+        if (i == 20) {
+            lights[0].x += 7;
+            lumino_set_lights(r, lights, 3, 0.3f);
+        }
+    }
+}
+
+// Frames drawn with the current kernels and flags, copied out of the
+// internal buffer (out has CHECK_WIDTH * CHECK_HEIGHT pixels)
+static int check_lightmap_frames(lumino_sprite sprite, int flags, uint32_t* out) {
+    LuminoRenderer r;
+    if (lumino_init_headless(&r, 1, CHECK_WIDTH, CHECK_HEIGHT, flags) != LUMINO_SUCCESS) return LUMINO_FAILURE;
+    lumino_light lights[3];
+    memset(lights, 0, sizeof(lights));
+    for (int i = 0; i < 3; i++) {
+        lights[i].x = 20 + i * 45.3f;
+        lights[i].y = 30 + i * 20.7f;
+        lights[i].color = (lumino_color){ 255 - i * 60, 200, 100 + i * 50, 255 };
+        lights[i].intensity = 0.8f + i;
+        lights[i].range = 30.0f + i * 25;
+        lights[i].enabled = 1;
+    }
+    for (int frame = 0; frame < 3; frame++) {
+        check_lightmap_scene(&r, sprite, lights, frame);
+        lumino_present(&r);
+    }
+    for (int y = 0; y < CHECK_HEIGHT; y++) {
+        memcpy(out + y * CHECK_WIDTH, r.internal_framebuffer + (size_t)y * r.stride, CHECK_WIDTH * sizeof(uint32_t));
+    }
+    lumino_shutdown(&r);
+    return LUMINO_SUCCESS;
+}
+
+// Lightmapped blits must give the scalar result bit for bit at every level,
+// also when deferred, pipelined or with dirty rects
+static int check_lightmap_levels(lumino_sprite sprite, int level) {
+    static const int modes[] = { 0, LUMINO_FLAG_DEFERRED, LUMINO_FLAG_DEFERRED | LUMINO_FLAG_PIPELINED,
+                                 LUMINO_FLAG_DIRTY_RECTS };
+    size_t size = (size_t)CHECK_WIDTH * CHECK_HEIGHT * sizeof(uint32_t);
+    uint32_t* ref = (uint32_t*)malloc(size);
+    uint32_t* out = (uint32_t*)malloc(size);
+    int wrong = -1;
+
+    lumino_dispatch_select(LUMINO_SIMD_SCALAR);
+    if (ref && out && check_lightmap_frames(sprite, 0, ref) == LUMINO_SUCCESS) {
+        lumino_dispatch_select(level);
+        wrong = 0;
+        for (int m = 0; m < (int)(sizeof(modes) / sizeof(modes[0])) && wrong >= 0; m++) {
+            if (check_lightmap_frames(sprite, modes[m], out) != LUMINO_SUCCESS) {
+                wrong = -1;
+                break;
+            }
+            for (int i = 0; i < CHECK_WIDTH * CHECK_HEIGHT; i++) {
+                wrong += out[i] != ref[i];
+            }
+        }
+    }
+    free(ref);
+    free(out);
+    return wrong;
+}
+
+// With a single light the lightmap must stay within 1 per channel of
+// lumino_draw_sprite_lit (it quantizes the falloff to 8.8 fixed point). The
+// light sits on a pixel, as the lit path measures integer distances.
+static int check_lightmap_lit(lumino_sprite sprite) {
+    LuminoRenderer lit, mapped;
+    if (lumino_init_headless(&lit, 1, CHECK_WIDTH, CHECK_HEIGHT, 0) != LUMINO_SUCCESS) return -1;
+    if (lumino_init_headless(&mapped, 1, CHECK_WIDTH, CHECK_HEIGHT, 0) != LUMINO_SUCCESS) {
+        lumino_shutdown(&lit);
+        return -1;
+    }
+    lumino_light light;
+    memset(&light, 0, sizeof(light));
+    light.x = 60.0f;
+    light.y = 50.0f;
+    light.color = (lumino_color){ 255, 200, 150, 255 };
+    light.intensity = 0.8f;
+    light.range = 40.0f;
+    light.enabled = 1;
+    lumino_clear(&lit);
+    lumino_clear(&mapped);
+    lumino_set_lights(&mapped, &light, 1, 0.2f);
+    for (int i = 0; i < 6; i++) {
+        sprite.x = 20 + i * 15;
+        sprite.y = 30 + (i & 1) * 20;
+        lumino_draw_sprite_lit(&lit, sprite, light, 0.2f);
+        lumino_draw_sprite_lightmap(&mapped, sprite);
+    }
+
+    int wrong = 0;
+    for (int y = 0; y < CHECK_HEIGHT; y++) {
+        for (int x = 0; x < CHECK_WIDTH; x++) {
+            uint32_t p = lit.internal_framebuffer[y * lit.stride + x];
+            uint32_t q = mapped.internal_framebuffer[y * mapped.stride + x];
+            for (int shift = 0; shift < 32; shift += 8) {
+                if (abs((int)((p >> shift) & 0xFF) - (int)((q >> shift) & 0xFF)) > 1) {
+                    wrong++;
+                    break;
+                }
+            }
+        }
+    }
+    lumino_shutdown(&lit);
+    lumino_shutdown(&mapped);
+    return wrong;
+}
+
+static int check_lightmap(int level) {
+    lumino_sprite sprite;
+    int wrong = -1;
+    if (check_sprite(&sprite) == LUMINO_SUCCESS) {
+        int levels = check_lightmap_levels(sprite, level);
+        int lit = check_lightmap_lit(sprite);
+        wrong = levels < 0 || lit < 0 ? -1 : levels + lit;
+    }
+    lumino_sprite_free(&sprite);
+    return wrong;
+}
+
+static const check_case check_cases[] = {
+    { "fill rect blend", check_fill_blend },
+    { "sprite blend",    check_sprite_blend },
+    { "dirty rects",     check_dirty_rects },
+    { "deferred",        check_deferred },
+    { "lightmap",        check_lightmap },
+};
+
+//-----------------------------------------------------------------------------
+// Driver
+//-----------------------------------------------------------------------------
+
+int lumino_run_checks(const char* filter) {
+    // before the first renderer init would replace the level picked below
+    lumino_dispatch_init();
+    int default_level = lumino_dispatch_level();
+    int case_count = (int)(sizeof(check_cases) / sizeof(check_cases[0]));
+    int failed = 0;
+
+    for (int k = 0; k < case_count; k++) {
+        const check_case* cc = &check_cases[k];
+        if (filter && !strstr(cc->name, filter)) continue;
+
+        for (int level = LUMINO_SIMD_SCALAR; level <= LUMINO_SIMD_NEON; level++) {
+            if (lumino_dispatch_select(level) != LUMINO_SUCCESS) continue;
+
+            int wrong = cc->run(level);
+            lumino_dispatch_select(level);  // checks may switch levels for their reference
+            if (wrong == 0) {
+                printf("check %-18s %-7s ok\n", cc->name, lumino_dispatch_name(level));
+            } else if (wrong < 0) {
+                printf("check %-18s %-7s setup failed\n", cc->name, lumino_dispatch_name(level));
+                failed = 1;
+            } else {
+                printf("check %-18s %-7s FAILED, %d pixels differ\n", cc->name, lumino_dispatch_name(level), wrong);
+                failed = 1;
+            }
+        }
+    }
+
+    lumino_dispatch_select(default_level);
+    return failed ? LUMINO_FAILURE : LUMINO_SUCCESS;
+}
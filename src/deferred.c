@@ -0,0 +1,270 @@
+// deferred.c - command buffer, tile binning and parallel tile rasterization
+
+#include "deferred.h"
+#include "primitives.h"
+#include "threadpool.h"
+#include <string.h>
+
+#define COMMAND_CHUNK 256
+
+// Commands are appended to chunks in the frame arena, so a frame's buffer
+// never needs to move
+typedef struct command_chunk {
+    struct command_chunk* next;
+    int count;
+    lumino_command commands[COMMAND_CHUNK];
+} command_chunk;
+
+struct lumino_deferred {
+    command_chunk* first;
+    command_chunk* last;
+    int count;                           // commands recorded since the last flush
+    int tiles_x, tiles_y;
+};
+
+// Per flush: the commands touching tile t are bins[bin_start[t] .. bin_start[t + 1])
+typedef struct {
+    LuminoRenderer* renderer;
+    const lumino_command** bins;
+    const int* bin_start;
+} flush_job;
+
+int lumino_deferred_init(LuminoRenderer* renderer) {
+    lumino_deferred* d = (lumino_deferred*)lumino_persistent_alloc(renderer, sizeof(lumino_deferred));
+    if (!d) {
+        return LUMINO_FAILURE;
+    }
+    d->first = d->last = NULL;
+    d->count = 0;
+    d->tiles_x = (renderer->internal_width + LUMINO_TILE_SIZE - 1) / LUMINO_TILE_SIZE;
+    d->tiles_y = (renderer->internal_height + LUMINO_TILE_SIZE - 1) / LUMINO_TILE_SIZE;
+    renderer->deferred = d;
+
+    // tiles go to the same workers as the band upscale
+    if (!renderer->upscale_pool) {
+        lumino_set_upscale_threads(renderer, 0);
+    }
+    return LUMINO_SUCCESS;
+}
+
+lumino_command* lumino_defer(LuminoRenderer* renderer, int op) {
+    lumino_deferred* d = renderer->deferred;
+    if (!d) {
+        return NULL;
+    }
+    if (!d->last || d->last->count == COMMAND_CHUNK) {
+        command_chunk* chunk = (command_chunk*)lumino_frame_alloc(renderer, sizeof(command_chunk));
+        if (!chunk) {
+            lumino_flush(renderer);
+            return NULL;
+        }
+        chunk->next = NULL;
+        chunk->count = 0;
+        if (d->last) d->last->next = chunk;
+        else d->first = chunk;
+        d->last = chunk;
+    }
+    lumino_command* c = &d->last->commands[d->last->count++];
+    c->op = op;
+    d->count++;
+    return c;
+}
+
+// Screen bounds of a command, clipped to the framebuffer; 0 if nothing is visible
+static int command_bounds(const LuminoRenderer* renderer, const lumino_command* c,
+                          int* x0, int* y0, int* x1, int* y1) {
+    switch (c->op) {
+        case LUMINO_CMD_LINE:
+        case LUMINO_CMD_LINE_BLEND:
+        case LUMINO_CMD_LINE_INDEX:
+            *x0 = c->line.x1 < c->line.x2 ? c->line.x1 : c->line.x2;
+            *y0 = c->line.y1 < c->line.y2 ? c->line.y1 : c->line.y2;
+            *x1 = (c->line.x1 < c->line.x2 ? c->line.x2 : c->line.x1) + 1;
+            *y1 = (c->line.y1 < c->line.y2 ? c->line.y2 : c->line.y1) + 1;
+            break;
+        case LUMINO_CMD_SPRITE:
+        case LUMINO_CMD_SPRITE_BLEND:
+        case LUMINO_CMD_SPRITE_LIT:
+        case LUMINO_CMD_SPRITE_INDEX:
+        case LUMINO_CMD_SPRITE_LIGHTMAP:
+            *x0 = c->sprite.sprite.x;
+            *y0 = c->sprite.sprite.y;
+            *x1 = *x0 + c->sprite.sprite.width;
+            *y1 = *y0 + c->sprite.sprite.height;
+            break;
+        default:
+            *x0 = c->rect.x;
+            *y0 = c->rect.y;
+            *x1 = *x0 + c->rect.w;
+            *y1 = *y0 + c->rect.h;
+            break;
+    }
+    if (*x0 < 0) *x0 = 0;
+    if (*y0 < 0) *y0 = 0;
+    if (*x1 > renderer->internal_width) *x1 = renderer->internal_width;
+    if (*y1 > renderer->internal_height) *y1 = renderer->internal_height;
+    return *x0 < *x1 && *y0 < *y1;
+}
+
+// Replay one command into a tile view, whose origin is (tx, ty) on screen.
+// Every op stays pixel-exact: lines keep their endpoints and walk only the
+// steps inside the tile, sprites are translated and clip against the view
+// size, and only fills (which don't clip) are cut to the view here.
+static void run_command(LuminoRenderer* view, const lumino_command* c, int tx, int ty) {
+    switch (c->op) {
+        case LUMINO_CMD_PIXEL:
+            lumino_draw_pixel(view, c->rect.x - tx, c->rect.y - ty, c->rect.color);
+            break;
+        case LUMINO_CMD_PIXEL_BLEND:
+            lumino_draw_pixel_blend(view, c->rect.x - tx, c->rect.y - ty, c->rect.color);
+            break;
+        case LUMINO_CMD_PIXEL_INDEX:
+            lumino_draw_pixel_index(view, c->rect.x - tx, c->rect.y - ty, c->rect.index);
+            break;
+        case LUMINO_CMD_LINE:
+        case LUMINO_CMD_LINE_BLEND:
+        case LUMINO_CMD_LINE_INDEX:
+            lumino_replay_line(view, c, tx, ty);
+            break;
+        case LUMINO_CMD_FILL:
+        case LUMINO_CMD_FILL_BLEND: {
+            int x0 = c->rect.x - tx, y0 = c->rect.y - ty;
+            int x1 = x0 + c->rect.w, y1 = y0 + c->rect.h;
+            if (x0 < 0) x0 = 0;
+            if (y0 < 0) y0 = 0;
+            if (x1 > view->internal_width) x1 = view->internal_width;
+            if (y1 > view->internal_height) y1 = view->internal_height;
+            if (x0 >= x1 || y0 >= y1) break;
+            if (c->op == LUMINO_CMD_FILL) {
+                lumino_fill_rectangle(view, x0, y0, x1 - x0, y1 - y0, c->rect.color);
+            } else {
+                lumino_fill_rectangle_blend(view, x0, y0, x1 - x0, y1 - y0, c->rect.color);
+            }
+            break;
+        }
+        case LUMINO_CMD_FILL_INDEX:
+            lumino_fill_rectangle_index(view, c->rect.x - tx, c->rect.y - ty, c->rect.w, c->rect.h, c->rect.index);
+            break;
+        default: {
+            lumino_sprite sprite = c->sprite.sprite;
+            sprite.x -= tx;
+            sprite.y -= ty;
+            if (c->op == LUMINO_CMD_SPRITE) {
+                lumino_draw_sprite(view, sprite);
+            } else if (c->op == LUMINO_CMD_SPRITE_BLEND) {
+                lumino_draw_sprite_blend(view, sprite);
+            } else if (c->op == LUMINO_CMD_SPRITE_INDEX) {
+                lumino_draw_sprite_index(view, sprite);
+            } else if (c->op == LUMINO_CMD_SPRITE_LIGHTMAP) {
+                lumino_draw_sprite_lightmap(view, sprite);
+            } else {
+                lumino_light light = c->sprite.light;
+                light.x -= tx;
+                light.y -= ty;
+                lumino_draw_sprite_lit(view, sprite, light, c->sprite.ambient);
+            }
+            break;
+        }
+    }
+}
+
+// The renderer narrowed to one rect: same buffers and stride, origin moved,
+// drawing immediately and not tracking dirty rects (done when recording).
+// The lightmap was built when the draws were recorded and moves along.
+static void make_view(LuminoRenderer* view, int x, int y, int w, int h) {
+    view->internal_framebuffer += (size_t)y * view->stride + x;
+    if (view->index_buffer) {
+        view->index_buffer += (size_t)y * view->stride + x;
+    }
+    if (view->lightmap) {
+        view->lightmap += ((size_t)y * view->stride + x) * 4;
+    }
+    view->internal_width = w;
+    view->internal_height = h;
+    view->flags &= ~LUMINO_FLAG_DIRTY_RECTS;
+    view->deferred = NULL;
+    view->profile = NULL;
+}
+
+static void raster_tile(void* data, int tile) {
+    flush_job* job = (flush_job*)data;
+    int begin = job->bin_start[tile];
+    int end = job->bin_start[tile + 1];
+    if (begin == end) {
+        return;
+    }
+
+    const lumino_deferred* d = job->renderer->deferred;
+    int tx = (tile % d->tiles_x) * LUMINO_TILE_SIZE;
+    int ty = (tile / d->tiles_x) * LUMINO_TILE_SIZE;
+    int tw = job->renderer->internal_width - tx;
+    int th = job->renderer->internal_height - ty;
+    if (tw > LUMINO_TILE_SIZE) tw = LUMINO_TILE_SIZE;
+    if (th > LUMINO_TILE_SIZE) th = LUMINO_TILE_SIZE;
+
+    LuminoRenderer view = *job->renderer;
+    make_view(&view, tx, ty, tw, th);
+    for (int i = begin; i < end; i++) {
+        run_command(&view, job->bins[i], tx, ty);
+    }
+}
+
+void lumino_flush(LuminoRenderer* renderer) {
+    lumino_deferred* d = renderer->deferred;
+    if (!d || d->count == 0) {
+        return;
+    }
+    int tiles = d->tiles_x * d->tiles_y;
+
+    // count the commands per tile, then place them after a prefix sum
+    int* bin_start = (int*)lumino_arena_calloc(&renderer->frame_arena, tiles + 1, sizeof(int));
+    int* cursor = (int*)lumino_frame_alloc(renderer, tiles * sizeof(int));
+    const lumino_command** bins = NULL;
+    if (bin_start && cursor) {
+        for (command_chunk* chunk = d->first; chunk; chunk = chunk->next) {
+            for (int i = 0; i < chunk->count; i++) {
+                int x0, y0, x1, y1;
+                if (!command_bounds(renderer, &chunk->commands[i], &x0, &y0, &x1, &y1)) continue;
+                for (int ty = y0 / LUMINO_TILE_SIZE; ty <= (y1 - 1) / LUMINO_TILE_SIZE; ty++) {
+                    for (int tx = x0 / LUMINO_TILE_SIZE; tx <= (x1 - 1) / LUMINO_TILE_SIZE; tx++) {
+                        bin_start[ty * d->tiles_x + tx + 1]++;
+                    }
+                }
+            }
+        }
+        for (int t = 0; t < tiles; t++) {
+            bin_start[t + 1] += bin_start[t];
+            cursor[t] = bin_start[t];
+        }
+        bins = (const lumino_command**)lumino_frame_alloc(renderer, (size_t)bin_start[tiles] * sizeof(*bins));
+    }
+
+    if (bins) {
+        // chunks are walked in order, so every bin stays in submission order
+        for (command_chunk* chunk = d->first; chunk; chunk = chunk->next) {
+            for (int i = 0; i < chunk->count; i++) {
+                int x0, y0, x1, y1;
+                if (!command_bounds(renderer, &chunk->commands[i], &x0, &y0, &x1, &y1)) continue;
+                for (int ty = y0 / LUMINO_TILE_SIZE; ty <= (y1 - 1) / LUMINO_TILE_SIZE; ty++) {
+                    for (int tx = x0 / LUMINO_TILE_SIZE; tx <= (x1 - 1) / LUMINO_TILE_SIZE; tx++) {
+                        bins[cursor[ty * d->tiles_x + tx]++] = &chunk->commands[i];
+                    }
+                }
+            }
+        }
+        flush_job job = { renderer, bins, bin_start };
+        lumino_pool_run(renderer->upscale_pool, raster_tile, &job, tiles);
+    } else {
+        // no memory for the bins: replay everything on this thread, one full-screen view
+        LuminoRenderer view = *renderer;
+        make_view(&view, 0, 0, renderer->internal_width, renderer->internal_height);
+        for (command_chunk* chunk = d->first; chunk; chunk = chunk->next) {
+            for (int i = 0; i < chunk->count; i++) {
+                run_command(&view, &chunk->commands[i], 0, 0);
+            }
+        }
+    }
+
+    d->first = d->last = NULL;
+    d->count = 0;
+}
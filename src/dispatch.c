@@ -0,0 +1,75 @@
+// dispatch.c - runtime CPU detection and SIMD kernel selection
+
+#include "dispatch.h"
+#include "lumino.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* level_names[] = { "scalar", "sse2", "avx2", "neon" };
+
+static int current_level = LUMINO_SIMD_SCALAR;
+static int initialized = 0;
+
+int lumino_dispatch_detect(void) {
+#if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
+    return LUMINO_SIMD_NEON;
+#elif defined(LUMINO_X86)
+    // cpuid (+ xgetbv for the OS-saved AVX state) through the compiler builtins
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return LUMINO_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return LUMINO_SIMD_SSE2;
+    return LUMINO_SIMD_SCALAR;
+#else
+    return LUMINO_SIMD_SCALAR;
+#endif
+}
+
+// scalar always works; x86 levels are cumulative, NEON stands alone
+static int level_supported(int level, int best) {
+    if (level == LUMINO_SIMD_SCALAR) return 1;
+    if (best == LUMINO_SIMD_NEON) return level == LUMINO_SIMD_NEON;
+    return level != LUMINO_SIMD_NEON && level <= best;
+}
+
+int lumino_dispatch_select(int level) {
+    if (level < LUMINO_SIMD_SCALAR || level > LUMINO_SIMD_NEON ||
+        !level_supported(level, lumino_dispatch_detect())) {
+        return LUMINO_FAILURE;
+    }
+    lumino_upscale_select_kernels(level);
+    lumino_primitives_select_kernels(level);
+    lumino_sprite_select_kernels(level);
+    current_level = level;
+    return LUMINO_SUCCESS;
+}
+
+void lumino_dispatch_init(void) {
+    if (initialized) return;
+    initialized = 1;
+
+    int level = lumino_dispatch_detect();
+    const char* forced = getenv("LUMINO_SIMD");
+    if (forced && *forced) {
+        int i;
+        for (i = 0; i <= LUMINO_SIMD_NEON; i++) {
+            if (strcmp(forced, level_names[i]) == 0) break;
+        }
+        if (i <= LUMINO_SIMD_NEON && level_supported(i, level)) {
+            level = i;
+        } else {
+            fprintf(stderr, "LUMINO_SIMD=%s is not available, using %s\n",
+                    forced, level_names[level]);
+        }
+    }
+    lumino_dispatch_select(level);
+}
+
+int lumino_dispatch_level(void) {
+    return current_level;
+}
+
+const char* lumino_dispatch_name(int level) {
+    if (level < LUMINO_SIMD_SCALAR || level > LUMINO_SIMD_NEON) return "unknown";
+    return level_names[level];
+}
@@ -3,7 +3,13 @@
 #include "lumino.h"
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <limits.h>
 #include "upscale.h"
+#include "threadpool.h"
+#include "dispatch.h"
+#include "profile.h"
+#include "deferred.h"
 
 // the SDL window
 static SDL_Window* window = NULL;
@@ -20,6 +26,15 @@ static const Uint8 *keyboard_state = NULL; // Current keyboard state
 static Uint8 previous_keyboard_state[SDL_NUM_SCANCODES]; // Previous keyboard state
 
 
+// first block of each renderer arena, both grow on demand
+#define LUMINO_FRAME_ARENA_SIZE (256 * 1024)
+#define LUMINO_PERSISTENT_ARENA_SIZE (64 * 1024)
+
+static int pipeline_init(LuminoRenderer* renderer);
+static void pipeline_destroy(LuminoRenderer* renderer);
+static void renderer_release(LuminoRenderer* renderer);
+static void update_window_title(LuminoRenderer* renderer);
+
 int mouse_location[2] = {0, 0};
 int mouse_clicked = 0;
 int mouse_down = 0;
@@ -34,6 +49,11 @@ int mouse_down = 0;
 // 1 SDL_UpdateTexture(texture, NULL, framebuffer, LUMINO_WIDTH * sizeof(uint32_t));
 // 2 SDL_RenderCopy(renderer, texture, NULL, NULL);
 // 3 SDL_RenderPresent(renderer);
+//
+// With LUMINO_FLAG_ZERO_COPY there is no CPU-side framebuffer: the texture is
+// locked and upscale_fn writes into it directly, which replaces step 1.
+// With LUMINO_FLAG_SDL_SCALE the texture is internal-sized: step 1 uploads the
+// internal framebuffer and step 2 stretches it (nearest) to the window.
 
 void lumino_initialize_keyboard_state() {
     keyboard_state = SDL_GetKeyboardState(NULL);
@@ -41,7 +61,9 @@ void lumino_initialize_keyboard_state() {
 }
 
 void lumino_update_keyboard_state() {
-    memcpy(previous_keyboard_state, keyboard_state, sizeof(previous_keyboard_state));
+    if (keyboard_state) {
+        memcpy(previous_keyboard_state, keyboard_state, sizeof(previous_keyboard_state));
+    }
     keyboard_state = SDL_GetKeyboardState(NULL);
 }
 
@@ -57,10 +79,97 @@ int lumino_is_key_up(SDL_Scancode key) {
     return keyboard_state && !keyboard_state[key] && previous_keyboard_state[key];
 }
 
+//-----------------------------------------------------------------------------
+// Palette reverse lookup
+//-----------------------------------------------------------------------------
+
+_Static_assert(LUMINO_PALETTE_HASH_SIZE >= 512 &&
+               (LUMINO_PALETTE_HASH_SIZE & (LUMINO_PALETTE_HASH_SIZE - 1)) == 0,
+               "LUMINO_PALETTE_HASH_SIZE must be a power of two, >= 2x the 256 palette entries");
+
+static inline uint32_t palette_hash_slot(uint32_t key) {
+    // Fibonacci hashing, the top log2(LUMINO_PALETTE_HASH_SIZE) bits of the product pick the slot
+    return (key * 2654435761u) >> (32 - __builtin_ctz(LUMINO_PALETTE_HASH_SIZE));
+}
+
+static inline uint32_t palette_key(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    return ((uint32_t)a << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+}
+
+// Insert key -> index with linear probing; the first index for a color wins
+static void palette_hash_insert(LuminoRenderer* renderer, uint32_t key, int index) {
+    uint32_t slot = palette_hash_slot(key);
+    while (renderer->palette_hash_index[slot] >= 0) {
+        if (renderer->palette_hash_keys[slot] == key) return;
+        slot = (slot + 1) & (LUMINO_PALETTE_HASH_SIZE - 1);
+    }
+    renderer->palette_hash_keys[slot] = key;
+    renderer->palette_hash_index[slot] = (int16_t)index;
+}
+
+int lumino_palette_find(LuminoRenderer* renderer, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    uint32_t key = palette_key(r, g, b, a);
+    uint32_t slot = palette_hash_slot(key);
+    while (renderer->palette_hash_index[slot] >= 0) {
+        if (renderer->palette_hash_keys[slot] == key) {
+            return renderer->palette_hash_index[slot];
+        }
+        slot = (slot + 1) & (LUMINO_PALETTE_HASH_SIZE - 1);
+    }
+    return -1;
+}
+
+// brute force squared RGBA distance over the palette
+static int palette_search_nearest(const LuminoRenderer* renderer, int r, int g, int b, int a) {
+    int best = 0;
+    int best_dist = 0x7FFFFFFF;
+    for (int i = 0; i < renderer->palette_size; i++) {
+        const uint8_t* p = &renderer->palette[i * 4];
+        int dr = p[0] - r, dg = p[1] - g, db = p[2] - b, da = p[3] - a;
+        int dist = dr*dr + dg*dg + db*db + da*da;
+        if (dist < best_dist) {
+            best_dist = dist;
+            best = i;
+            if (dist == 0) break;
+        }
+    }
+    return best;
+}
+
+uint8_t lumino_palette_nearest(LuminoRenderer* renderer, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    int exact = lumino_palette_find(renderer, r, g, b, a);
+    if (exact >= 0) {
+        return (uint8_t)exact;
+    }
+    if (a != 255) {
+        return (uint8_t)palette_search_nearest(renderer, r, g, b, a);
+    }
+
+    if (!renderer->palette_nearest_cache) {
+        renderer->palette_nearest_cache = (int16_t*)lumino_persistent_alloc(renderer, 32768 * sizeof(int16_t));
+        if (!renderer->palette_nearest_cache) {
+            return (uint8_t)palette_search_nearest(renderer, r, g, b, a);
+        }
+        memset(renderer->palette_nearest_cache, 0xFF, 32768 * sizeof(int16_t));
+    }
+
+    int cell = ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+    int16_t index = renderer->palette_nearest_cache[cell];
+    if (index < 0) {
+        // search from the center of the cell so the result doesn't depend on
+        // which color hit it first
+        index = (int16_t)palette_search_nearest(renderer, (r & ~7) | 4, (g & ~7) | 4, (b & ~7) | 4, 255);
+        renderer->palette_nearest_cache[cell] = index;
+    }
+    return (uint8_t)index;
+}
+
 // initialize the lumino renderer returns 0 on success and 1 on failure
-int lumino_renderer_init(LuminoRenderer* renderer, int upscale_factor, int internal_width, int internal_height) {
-    
-    if (upscale_factor != 1 && upscale_factor != 2 && upscale_factor != 4 && upscale_factor != 8) {
+int lumino_renderer_init(LuminoRenderer* renderer, int upscale_factor, int internal_width, int internal_height, int flags) {
+    // pick SIMD kernels for this CPU (once per process)
+    lumino_dispatch_init();
+
+    if (upscale_factor < 1) {
         return LUMINO_INVALID_UPSCALE;  // Invalid upscale factor
     }
 
@@ -68,20 +177,30 @@ int lumino_renderer_init(LuminoRenderer* renderer, int upscale_factor, int inter
         return LUMINO_DIMS_TOO_SMALL;  // Invalid internal dimensions
     }
 
-    // check if dims are divisible by 4 due to SIMD
-    if (internal_width % 4 != 0 || internal_height % 4 != 0) {
-        return LUMINO_DIMS_NOT_DIVISIBLE_BY_4;  // Invalid internal dimensions
-    }
-
-    lumino_initialize_keyboard_state();
-
     // Initialize the renderer structure
     renderer->palette_size = 1;  // Initialize palette size
+    // index 0 is the clear color: transparent black
+    memset(renderer->palette, 0, sizeof(renderer->palette));
+    memset(renderer->palette_argb, 0, sizeof(renderer->palette_argb));
+    renderer->palette_cycle_count = 0;
+    memset(renderer->palette_hash_index, 0xFF, sizeof(renderer->palette_hash_index));
+    renderer->palette_nearest_cache = NULL;
+    palette_hash_insert(renderer, 0, 0);
     renderer->internal_width = internal_width;
     renderer->internal_height = internal_height;
     renderer->upscale_factor = upscale_factor;
     renderer->width = internal_width * upscale_factor;
     renderer->height = internal_height * upscale_factor;
+    if (flags & LUMINO_FLAG_PIPELINED) {
+        // the present thread upscales whole frames into its own framebuffers:
+        // no texture target, and dirty rects would miss the other buffer's draws
+        flags &= ~(LUMINO_FLAG_ZERO_COPY | LUMINO_FLAG_SDL_SCALE | LUMINO_FLAG_DIRTY_RECTS);
+    }
+    renderer->flags = flags;
+    // padded rows: SIMD kernels never straddle a cache line at a row start
+    // and handle the width with a scalar tail, so any width works
+    renderer->stride = (internal_width + LUMINO_STRIDE_ALIGN - 1) & ~(LUMINO_STRIDE_ALIGN - 1);
+    renderer->framebuffer_stride = (renderer->width + LUMINO_STRIDE_ALIGN - 1) & ~(LUMINO_STRIDE_ALIGN - 1);
 
     switch (upscale_factor) {
         case 1:
@@ -98,72 +217,196 @@ int lumino_renderer_init(LuminoRenderer* renderer, int upscale_factor, int inter
             break;
         
         default:
-            return LUMINO_FAILURE;  // Invalid upscale factor
+            // 3x, 5x, 6x, ... go through the generic integer kernel
+            renderer->upscale_fn = upscaleNx;
+            break;
     }
 
-    // Allocate memory for the internal framebuffer
-    renderer->internal_framebuffer = (uint32_t*)malloc(internal_width * internal_height * sizeof(uint32_t));
+    renderer->upscale_pool = NULL;
+    renderer->present_callback = NULL;
+    renderer->present_user = NULL;
+    renderer->profile = NULL;
+    renderer->deferred = NULL;
+    renderer->pipeline = NULL;
+    renderer->present_fence = 0;
+    renderer->light_count = 0;
+    renderer->light_ambient = 1.0f;
+    renderer->lightmap = NULL;
+    renderer->lightmap_stale = 1;
+    renderer->dirty.count = 0;
+    renderer->drawn.count = 0;
+    renderer->drawn_last_frame.count = 0;
+    lumino_arena_init(&renderer->frame_arena, LUMINO_FRAME_ARENA_SIZE);
+    lumino_arena_init(&renderer->persistent_arena, LUMINO_PERSISTENT_ARENA_SIZE);
+
+    // The pixel buffers live in the persistent arena, which hands out
+    // 64-byte aligned memory; with the padded strides every row is aligned
+    size_t internal_pixels = (size_t)renderer->stride * internal_height;
+    renderer->internal_framebuffer = (uint32_t*)lumino_arena_calloc(&renderer->persistent_arena, internal_pixels, sizeof(uint32_t));
     if (!renderer->internal_framebuffer) {
+        lumino_arena_destroy(&renderer->persistent_arena);
         return LUMINO_FAILURE;  // Memory allocation failed
     }
+
+    // indexed mode rasterizes 1 byte per pixel, converted through the palette at present
+    renderer->index_buffer = NULL;
+    if (flags & LUMINO_FLAG_INDEXED) {
+        renderer->index_buffer = (uint8_t*)lumino_arena_calloc(&renderer->persistent_arena, internal_pixels, sizeof(uint8_t));
+        if (!renderer->index_buffer) {
+            lumino_arena_destroy(&renderer->persistent_arena);
+            return LUMINO_FAILURE;  // Memory allocation failed
+        }
+    }
     
-    renderer->framebuffer = (uint32_t*)malloc(renderer->width * renderer->height * sizeof(uint32_t));
-    if (!renderer->framebuffer) {
-        free(renderer->internal_framebuffer);
+    // zero-copy presents upscale into the locked texture and SDL-scaled
+    // presents upload the internal framebuffer, neither needs a framebuffer
+    renderer->framebuffer = NULL;
+    if (!(flags & (LUMINO_FLAG_ZERO_COPY | LUMINO_FLAG_SDL_SCALE))) {
+        renderer->framebuffer = (uint32_t*)lumino_arena_alloc(&renderer->persistent_arena,
+            (size_t)renderer->framebuffer_stride * renderer->height * sizeof(uint32_t));
+        if (!renderer->framebuffer) {
+            lumino_arena_destroy(&renderer->persistent_arena);
+            return LUMINO_FAILURE;  // Memory allocation failed
+        }
+    }
+
+    if (flags & LUMINO_FLAG_THREADED_UPSCALE) {
+        // falls back to single-threaded if the pool can't be created
+        lumino_set_upscale_threads(renderer, 0);
+    }
+
+    if ((flags & LUMINO_FLAG_DEFERRED) && lumino_deferred_init(renderer) != LUMINO_SUCCESS) {
+        lumino_pool_destroy(renderer->upscale_pool);
+        lumino_arena_destroy(&renderer->persistent_arena);
         return LUMINO_FAILURE;  // Memory allocation failed
     }
 
+    if ((flags & LUMINO_FLAG_PIPELINED) && pipeline_init(renderer) != LUMINO_SUCCESS) {
+        lumino_pool_destroy(renderer->upscale_pool);
+        lumino_arena_destroy(&renderer->persistent_arena);
+        return LUMINO_FAILURE;
+    }
+
+    if (flags & LUMINO_FLAG_DIRTY_RECTS) {
+        // the buffers start out uninitialized: the first clear and present cover everything
+        SDL_Rect all = { 0, 0, internal_width, internal_height };
+        renderer->drawn_last_frame.rects[0] = all;
+        renderer->drawn_last_frame.count = 1;
+        renderer->dirty.rects[0] = all;
+        renderer->dirty.count = 1;
+    }
+
     return LUMINO_SUCCESS;  // Success
 }
 
 // Initialize the window and framebuffer
 int lumino_init(LuminoRenderer* renderer, int upscale_factor, int internal_width, int internal_height) {
-    int result = lumino_renderer_init(renderer, upscale_factor, internal_width, internal_height);
+    return lumino_init_ex(renderer, upscale_factor, internal_width, internal_height, 0);
+}
+
+int lumino_init_headless(LuminoRenderer* renderer, int upscale_factor, int internal_width, int internal_height, int flags) {
+    // without a texture the upscale always goes to the framebuffer
+    flags &= ~(LUMINO_FLAG_ZERO_COPY | LUMINO_FLAG_SDL_SCALE);
+    return lumino_renderer_init(renderer, upscale_factor, internal_width, internal_height, flags | LUMINO_FLAG_HEADLESS);
+}
+
+void lumino_set_present_callback(LuminoRenderer* renderer, lumino_present_fn callback, void* user) {
+    renderer->present_callback = callback;
+    renderer->present_user = user;
+}
+
+int lumino_init_ex(LuminoRenderer* renderer, int upscale_factor, int internal_width, int internal_height, int flags) {
+    flags &= ~LUMINO_FLAG_HEADLESS;
+    int result = lumino_renderer_init(renderer, upscale_factor, internal_width, internal_height, flags);
     if (result != LUMINO_SUCCESS) {
         return result;  // Return error code from renderer initialization
     }
 
     // Initialize the SDL2 library
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        // If SDL initialization fails, return an error code
+        // If SDL initialization fails, stop the renderer's threads and return an error code
+        renderer_release(renderer);
         return LUMINO_FAILURE;
     }
 
     // Create an SDL window at the center of the screen with specified width and height
     window = SDL_CreateWindow("Lumino Renderer", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, renderer->width, renderer->height, SDL_WINDOW_SHOWN);
     if (!window) {
-        // If window creation fails, clean up SDL and return error code
+        // If window creation fails, clean up the renderer and SDL, then return error code
+        renderer_release(renderer);
         SDL_Quit();
         return LUMINO_FAILURE;
     }
 
     // Create a renderer that will draw directly to the window, with hardware acceleration
     sdl_renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
-        // If renderer creation fails, clean up the window and SDL, then return error code
+    if (!sdl_renderer) {
+        // If renderer creation fails, clean up the renderer, the window and SDL, then return error code
+        renderer_release(renderer);
         SDL_DestroyWindow(window);
         SDL_Quit();
         return LUMINO_FAILURE;
     }
 
     // Create an SDL texture that will hold the pixel data to be rendered
-    texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, renderer->width, renderer->height);
+    int texture_width = renderer->width;
+    int texture_height = renderer->height;
+    if (renderer->flags & LUMINO_FLAG_SDL_SCALE) {
+        // let SDL_RenderCopy do the upscale; the hint applies to textures created after it
+        SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+        texture_width = renderer->internal_width;
+        texture_height = renderer->internal_height;
+    }
+    texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, texture_width, texture_height);
     if (!texture) {
         // If texture creation fails, clean up resources and return error code
+        renderer_release(renderer);
         SDL_DestroyRenderer(sdl_renderer);
         SDL_DestroyWindow(window);
         SDL_Quit();
         return LUMINO_FAILURE;
     }
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+    if (renderer->flags & LUMINO_FLAG_SDL_SCALE) {
+        SDL_SetTextureScaleMode(texture, SDL_ScaleModeNearest);
+    }
+#endif
+
+    lumino_initialize_keyboard_state();
 
     return LUMINO_SUCCESS;  // Return success
 }
 
+// Stop the renderer's threads and free its memory. The SDL objects are left
+// to lumino_shutdown (or to lumino_init_ex when it fails halfway).
+static void renderer_release(LuminoRenderer* renderer) {
+    // Stop the upscale workers before freeing what they read and write
+    lumino_pool_destroy(renderer->upscale_pool);
+    renderer->upscale_pool = NULL;
+
+    lumino_profile_destroy(renderer->profile);
+    renderer->profile = NULL;
+
+    // the present thread hands out its last frame, then stops
+    pipeline_destroy(renderer);
+
+    // the pixel buffers, the lightmap and the palette cache live in the persistent arena
+    lumino_arena_destroy(&renderer->frame_arena);
+    lumino_arena_destroy(&renderer->persistent_arena);
+    renderer->palette_nearest_cache = NULL;
+    renderer->lightmap = NULL;
+    renderer->index_buffer = NULL;
+    renderer->internal_framebuffer = NULL;
+    renderer->framebuffer = NULL;
+}
+
 // Clean up SDL and resources
 void lumino_shutdown(LuminoRenderer* renderer) {
-    // Free the internal framebuffer
-    free(renderer->internal_framebuffer);
-    free(renderer->framebuffer);
+    renderer_release(renderer);
+
+    if (renderer->flags & LUMINO_FLAG_HEADLESS) {
+        return;  // SDL was never initialized
+    }
     
     // Destroy the texture, renderer, and window
     SDL_DestroyTexture(texture);
@@ -207,9 +450,143 @@ int lumino_should_run(void) {
     return running;
 }
 
-// Clear the framebuffer to black
+//-----------------------------------------------------------------------------
+// Dirty rectangles
+//-----------------------------------------------------------------------------
+
+static inline SDL_Rect rect_union(const SDL_Rect* a, const SDL_Rect* b) {
+    int x0 = a->x < b->x ? a->x : b->x;
+    int y0 = a->y < b->y ? a->y : b->y;
+    int x1 = a->x + a->w > b->x + b->w ? a->x + a->w : b->x + b->w;
+    int y1 = a->y + a->h > b->y + b->h ? a->y + a->h : b->y + b->h;
+    SDL_Rect u = { x0, y0, x1 - x0, y1 - y0 };
+    return u;
+}
+
+// overlapping or sharing an edge
+static inline int rects_touch(const SDL_Rect* a, const SDL_Rect* b) {
+    return a->x <= b->x + b->w && b->x <= a->x + a->w &&
+           a->y <= b->y + b->h && b->y <= a->y + a->h;
+}
+
+static inline int rect_contains(const SDL_Rect* outer, const SDL_Rect* inner) {
+    return inner->x >= outer->x && inner->x + inner->w <= outer->x + outer->w &&
+           inner->y >= outer->y && inner->y + inner->h <= outer->y + outer->h;
+}
+
+// Add r, merging it with every rect it touches. When the list is full, r is
+// merged into the rect whose area grows the least.
+static void rect_list_add(lumino_rect_list* list, SDL_Rect r) {
+    // per-pixel marks mostly land inside the rect added last
+    if (list->count > 0 && rect_contains(&list->rects[list->count - 1], &r)) {
+        return;
+    }
+
+    for (;;) {
+        int merge = -1;
+        for (int i = 0; i < list->count; i++) {
+            if (rects_touch(&list->rects[i], &r)) {
+                merge = i;
+                break;
+            }
+        }
+        if (merge < 0 && list->count == LUMINO_MAX_DIRTY_RECTS) {
+            int best_growth = INT_MAX;
+            for (int i = 0; i < list->count; i++) {
+                SDL_Rect u = rect_union(&list->rects[i], &r);
+                int growth = u.w * u.h - list->rects[i].w * list->rects[i].h;
+                if (growth < best_growth) {
+                    best_growth = growth;
+                    merge = i;
+                }
+            }
+        }
+        if (merge < 0) {
+            break;
+        }
+        // the union may now touch others, so look again
+        r = rect_union(&list->rects[merge], &r);
+        list->rects[merge] = list->rects[--list->count];
+    }
+    list->rects[list->count++] = r;
+}
+
+void lumino_mark_dirty(LuminoRenderer* renderer, int x, int y, int w, int h) {
+    if (!(renderer->flags & LUMINO_FLAG_DIRTY_RECTS)) {
+        return;
+    }
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + w > renderer->internal_width ? renderer->internal_width : x + w;
+    int y1 = y + h > renderer->internal_height ? renderer->internal_height : y + h;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    SDL_Rect r = { x0, y0, x1 - x0, y1 - y0 };
+    rect_list_add(&renderer->drawn, r);
+    rect_list_add(&renderer->dirty, r);
+}
+
+// Reset the rects of one list; those regions then need uploading too
+static void clear_rect_list(LuminoRenderer* renderer, lumino_rect_list* list) {
+    int stride = renderer->stride;
+    for (int i = 0; i < list->count; i++) {
+        const SDL_Rect* r = &list->rects[i];
+        for (int row = r->y; row < r->y + r->h; row++) {
+            if (renderer->index_buffer) {
+                memset(renderer->index_buffer + (size_t)row * stride + r->x, 0, r->w);
+            } else {
+                memset(renderer->internal_framebuffer + (size_t)row * stride + r->x, 0, r->w * sizeof(uint32_t));
+            }
+        }
+        rect_list_add(&renderer->dirty, *r);
+    }
+    list->count = 0;
+}
+
+// Reset everything drawn since the last clear: earlier frames and this one so far
+static void clear_drawn_rects(LuminoRenderer* renderer) {
+    clear_rect_list(renderer, &renderer->drawn_last_frame);
+    clear_rect_list(renderer, &renderer->drawn);
+}
+
+// Only worth going rect by rect while the rects cover less than 3/4 of the frame
+static int dirty_rects_partial(const LuminoRenderer* renderer) {
+    long area = 0;
+    for (int i = 0; i < renderer->dirty.count; i++) {
+        area += (long)renderer->dirty.rects[i].w * renderer->dirty.rects[i].h;
+    }
+    return area * 4 < (long)renderer->internal_width * renderer->internal_height * 3;
+}
+
+// Frames that skip lumino_clear keep their pixels, so what they drew stays
+// pending for the next clear instead of replacing the older rects
+static void dirty_rects_end_frame(LuminoRenderer* renderer) {
+    for (int i = 0; i < renderer->drawn.count; i++) {
+        rect_list_add(&renderer->drawn_last_frame, renderer->drawn.rects[i]);
+    }
+    renderer->drawn.count = 0;
+    renderer->dirty.count = 0;
+}
+
+// Clear the framebuffer to black (palette index 0 in indexed mode)
 void lumino_clear(LuminoRenderer* renderer) {
-    memset(renderer->internal_framebuffer, 0, renderer->internal_width * renderer->internal_height * sizeof(uint32_t));
+    // draws recorded before the clear still land underneath it
+    lumino_flush(renderer);
+    uint64_t start = renderer->profile ? lumino_profile_now() : 0;
+
+    if (renderer->flags & LUMINO_FLAG_DIRTY_RECTS) {
+        clear_drawn_rects(renderer);
+    } else if (renderer->index_buffer) {
+        // the internal framebuffer is regenerated from the indices at present
+        memset(renderer->index_buffer, 0, (size_t)renderer->stride * renderer->internal_height);
+    } else {
+        memset(renderer->internal_framebuffer, 0, (size_t)renderer->stride * renderer->internal_height * sizeof(uint32_t));
+    }
+
+    if (renderer->profile) {
+        lumino_profile_add(renderer->profile, LUMINO_STAGE_CLEAR, start, lumino_profile_now());
+    }
 }
 
 inline uint32_t lumino_get_color(lumino_color color) {
@@ -217,6 +594,127 @@ inline uint32_t lumino_get_color(lumino_color color) {
 }
 
 
+// Palette used for this present: palette_argb as-is, or a copy in
+// palette_cycled with every cycle range rotated to the current time
+static const uint32_t* lumino_cycle_palette(LuminoRenderer* renderer) {
+    if (renderer->palette_cycle_count == 0) {
+        return renderer->palette_argb;
+    }
+
+    float seconds = SDL_GetTicks() / 1000.0f;
+    memcpy(renderer->palette_cycled, renderer->palette_argb, sizeof(renderer->palette_cycled));
+    for (int c = 0; c < renderer->palette_cycle_count; c++) {
+        const lumino_palette_cycle* cycle = &renderer->palette_cycles[c];
+        int len = cycle->last - cycle->first + 1;
+        int shift = (int)floorf(seconds * cycle->speed) % len;
+        if (shift < 0) shift += len;
+
+        // entry first + i shows the color that was shift entries behind it
+        for (int i = 0; i < len; i++) {
+            renderer->palette_cycled[cycle->first + (i + shift) % len] = renderer->palette_argb[cycle->first + i];
+        }
+    }
+    return renderer->palette_cycled;
+}
+
+// A band of internal rows [band * band_rows, +band_rows) and the matching
+// band_rows * upscale_factor destination rows
+typedef struct {
+    LuminoRenderer* renderer;
+    uint32_t* dst;
+    int dst_stride;
+    int band_rows;
+    const uint32_t* palette;             // indexed mode: palette with cycles applied
+    const uint32_t* src;                 // internal framebuffer to upscale
+    const uint8_t* index_src;            // index buffer instead, NULL outside indexed mode
+} upscale_band_job;
+
+static void upscale_band(void* data, int band) {
+    upscale_band_job* job = (upscale_band_job*)data;
+    LuminoRenderer* r = job->renderer;
+    int y0 = band * job->band_rows;
+    int rows = r->internal_height - y0;
+    if (rows > job->band_rows) rows = job->band_rows;
+
+    uint32_t* dst = job->dst + (size_t)y0 * r->upscale_factor * job->dst_stride;
+    if (job->index_src) {
+        // indexed mode: palette lookup fused into the upscale
+        palette_upscale(dst, job->dst_stride, job->index_src + (size_t)y0 * r->stride, r->stride,
+                        job->palette, r->internal_width, rows, r->upscale_factor);
+        return;
+    }
+    r->upscale_fn(dst, job->dst_stride,
+                  job->src + (size_t)y0 * r->stride, r->stride,
+                  r->internal_width, rows, r->upscale_factor);
+}
+
+// Upscale the internal framebuffer (or the index buffer, through the palette)
+// into dst, split into bands when a pool exists
+static void lumino_upscale_to(LuminoRenderer* renderer, uint32_t* dst, int dst_stride) {
+    const uint32_t* palette = renderer->index_buffer ? lumino_cycle_palette(renderer) : NULL;
+
+    if (!renderer->upscale_pool) {
+        upscale_band_job job = { renderer, dst, dst_stride, renderer->internal_height, palette,
+                                 renderer->internal_framebuffer, renderer->index_buffer };
+        upscale_band(&job, 0);
+        return;
+    }
+
+    // a few bands per thread so a descheduled worker doesn't stall the frame
+    int bands = lumino_pool_thread_count(renderer->upscale_pool) * 4;
+    if (bands > renderer->internal_height) bands = renderer->internal_height;
+
+    upscale_band_job job = { renderer, dst, dst_stride, 0, palette,
+                             renderer->internal_framebuffer, renderer->index_buffer };
+    job.band_rows = (renderer->internal_height + bands - 1) / bands;
+    bands = (renderer->internal_height + job.band_rows - 1) / job.band_rows;
+    lumino_pool_run(renderer->upscale_pool, upscale_band, &job, bands);
+}
+
+void lumino_upscale(LuminoRenderer* renderer) {
+    lumino_flush(renderer);
+    if (renderer->framebuffer) {
+        lumino_upscale_to(renderer, renderer->framebuffer, renderer->framebuffer_stride);
+    }
+}
+
+// Upscale one internal rect into dst, which points at the rect's upscaled origin
+static void lumino_upscale_rect(LuminoRenderer* renderer, uint32_t* dst, int dst_stride,
+                                const SDL_Rect* rect, const uint32_t* palette) {
+    int n = renderer->upscale_factor;
+    size_t src_offset = (size_t)rect->y * renderer->stride + rect->x;
+    if (renderer->index_buffer) {
+        palette_upscale(dst, dst_stride, renderer->index_buffer + src_offset, renderer->stride,
+                        palette, rect->w, rect->h, n);
+    } else {
+        renderer->upscale_fn(dst, dst_stride, renderer->internal_framebuffer + src_offset, renderer->stride,
+                             rect->w, rect->h, n);
+    }
+}
+
+int lumino_set_upscale_threads(LuminoRenderer* renderer, int threads) {
+    if (threads <= 0) {
+        threads = SDL_GetCPUCount();
+    }
+
+    lumino_pool_destroy(renderer->upscale_pool);
+    renderer->upscale_pool = lumino_pool_create(threads);
+
+    return (threads > 1 && !renderer->upscale_pool) ? LUMINO_FAILURE : LUMINO_SUCCESS;
+}
+
+void* lumino_frame_alloc(LuminoRenderer* renderer, size_t size) {
+    return lumino_arena_alloc(&renderer->frame_arena, size);
+}
+
+void* lumino_persistent_alloc(LuminoRenderer* renderer, size_t size) {
+    return lumino_arena_alloc(&renderer->persistent_arena, size);
+}
+
+uint64_t lumino_heap_allocations(const LuminoRenderer* renderer) {
+    return renderer->frame_arena.heap_allocations + renderer->persistent_arena.heap_allocations;
+}
+
 // Add a color to the palette
 void lumino_add_palette_color(LuminoRenderer* renderer, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
     if (renderer->palette_size < 256) {
@@ -224,45 +722,426 @@ void lumino_add_palette_color(LuminoRenderer* renderer, uint8_t r, uint8_t g, ui
         renderer->palette[renderer->palette_size * 4 + 1] = g;
         renderer->palette[renderer->palette_size * 4 + 2] = b;
         renderer->palette[renderer->palette_size * 4 + 3] = a;
+        renderer->palette_argb[renderer->palette_size] = lumino_get_color((lumino_color){r, g, b, a});
+        palette_hash_insert(renderer, palette_key(r, g, b, a), renderer->palette_size);
         renderer->palette_size++;
+
+        // nearest matches may have changed
+        if (renderer->palette_nearest_cache) {
+            memset(renderer->palette_nearest_cache, 0xFF, 32768 * sizeof(int16_t));
+        }
+    }
+}
+
+int lumino_add_palette_cycle(LuminoRenderer* renderer, uint8_t first, uint8_t last, float speed) {
+    if (last <= first || renderer->palette_cycle_count >= LUMINO_MAX_PALETTE_CYCLES) {
+        return LUMINO_FAILURE;
+    }
+    lumino_palette_cycle* cycle = &renderer->palette_cycles[renderer->palette_cycle_count++];
+    cycle->first = first;
+    cycle->last = last;
+    cycle->speed = speed;
+    return LUMINO_SUCCESS;
+}
+
+void lumino_clear_palette_cycles(LuminoRenderer* renderer) {
+    renderer->palette_cycle_count = 0;
+}
+
+// Charge the time since *mark to stage and restart the mark (no-op without profiling)
+static inline void profile_mark(LuminoRenderer* renderer, int stage, uint64_t* mark) {
+    if (renderer->profile) {
+        uint64_t now = lumino_profile_now();
+        lumino_profile_add(renderer->profile, stage, *mark, now);
+        *mark = now;
+    }
+}
+
+// Upscale and upload only the dirty rects (the texture keeps the rest)
+static void present_dirty_rects(LuminoRenderer* renderer, uint64_t* mark) {
+    const uint32_t* palette = renderer->index_buffer ? lumino_cycle_palette(renderer) : NULL;
+    int stride = renderer->stride;
+    int n = renderer->upscale_factor;
+
+    for (int i = 0; i < renderer->dirty.count; i++) {
+        const SDL_Rect* r = &renderer->dirty.rects[i];
+
+        if (renderer->flags & LUMINO_FLAG_SDL_SCALE) {
+            uint32_t* src = renderer->internal_framebuffer + (size_t)r->y * stride + r->x;
+            if (renderer->index_buffer) {
+                palette_upscale(src, stride, renderer->index_buffer + (size_t)r->y * stride + r->x, stride,
+                                palette, r->w, r->h, 1);
+            }
+            profile_mark(renderer, LUMINO_STAGE_UPSCALE, mark);
+            SDL_UpdateTexture(texture, r, src, stride * sizeof(uint32_t));
+            profile_mark(renderer, LUMINO_STAGE_UPLOAD, mark);
+            continue;
+        }
+
+        SDL_Rect scaled = { r->x * n, r->y * n, r->w * n, r->h * n };
+        if (renderer->flags & LUMINO_FLAG_ZERO_COPY) {
+            void* pixels;
+            int pitch;
+            if (SDL_LockTexture(texture, &scaled, &pixels, &pitch) == 0) {
+                profile_mark(renderer, LUMINO_STAGE_UPLOAD, mark);
+                lumino_upscale_rect(renderer, (uint32_t*)pixels, pitch / (int)sizeof(uint32_t), r, palette);
+                profile_mark(renderer, LUMINO_STAGE_UPSCALE, mark);
+                SDL_UnlockTexture(texture);
+            }
+            profile_mark(renderer, LUMINO_STAGE_UPLOAD, mark);
+            continue;
+        }
+
+        uint32_t* dst = renderer->framebuffer + (size_t)scaled.y * renderer->framebuffer_stride + scaled.x;
+        lumino_upscale_rect(renderer, dst, renderer->framebuffer_stride, r, palette);
+        profile_mark(renderer, LUMINO_STAGE_UPSCALE, mark);
+        if (!(renderer->flags & LUMINO_FLAG_HEADLESS)) {
+            SDL_UpdateTexture(texture, &scaled, dst, renderer->framebuffer_stride * sizeof(uint32_t));
+            profile_mark(renderer, LUMINO_STAGE_UPLOAD, mark);
+        }
     }
 }
 
+//-----------------------------------------------------------------------------
+// Pipelined present
+//-----------------------------------------------------------------------------
+
+// One frame's worth of buffers. The app draws into one set while the present
+// thread upscales the other.
+typedef struct {
+    uint32_t* internal;                  // internal_framebuffer while this set is drawn into
+    uint8_t* index;                      // index_buffer, NULL outside indexed mode
+    uint32_t* output;                    // upscaled frame, framebuffer once shown
+    uint32_t palette[256];               // indexed mode: cycled palette taken at submit
+    uint64_t fence;                      // last frame submitted from this set, 0 = none
+} present_buffers;
+
+typedef struct lumino_pipeline {
+    present_buffers sets[2];
+    int current;                         // set the app draws into
+
+    SDL_Thread* thread;
+    SDL_mutex* lock;
+    SDL_cond* work_ready;                // signalled when a frame is submitted
+    SDL_cond* work_done;                 // signalled when the thread finishes one
+    uint64_t submitted;                  // fence of the last frame handed to the thread
+    uint64_t completed;                  // fence of the last frame it finished
+    int in_flight;                       // set of the submitted frame
+    int quit;
+
+    uint64_t shown;                      // fence of the last frame uploaded or passed to the callback
+} lumino_pipeline;
+
+// The thread only reads the renderer's geometry and upscale_fn, which don't
+// change after init; everything per frame comes from the submitted set
+static int present_thread(void* data) {
+    LuminoRenderer* renderer = (LuminoRenderer*)data;
+    lumino_pipeline* p = renderer->pipeline;
+
+    SDL_LockMutex(p->lock);
+    for (;;) {
+        while (!p->quit && p->completed == p->submitted) {
+            SDL_CondWait(p->work_ready, p->lock);
+        }
+        if (p->completed == p->submitted) break;  // quitting with nothing left
+        const present_buffers* set = &p->sets[p->in_flight];
+        uint64_t fence = p->submitted;
+        SDL_UnlockMutex(p->lock);
+
+        upscale_band_job job = { renderer, set->output, renderer->framebuffer_stride, renderer->internal_height,
+                                 set->palette, set->internal, set->index };
+        upscale_band(&job, 0);
+
+        SDL_LockMutex(p->lock);
+        p->completed = fence;
+        SDL_CondBroadcast(p->work_done);
+    }
+    SDL_UnlockMutex(p->lock);
+    return 0;
+}
+
+static void pipeline_wait(lumino_pipeline* p, uint64_t fence) {
+    SDL_LockMutex(p->lock);
+    while (p->completed < fence) {
+        SDL_CondWait(p->work_done, p->lock);
+    }
+    SDL_UnlockMutex(p->lock);
+}
+
+// Upload and present a finished frame (headless: hand it to the callback),
+// unless it already was. The frame's fence must have signaled.
+static void pipeline_show(LuminoRenderer* renderer, uint64_t fence, uint64_t* mark) {
+    lumino_pipeline* p = renderer->pipeline;
+    if (fence <= p->shown) {
+        return;
+    }
+    const present_buffers* set = &p->sets[p->sets[0].fence == fence ? 0 : 1];
+    p->shown = fence;
+    renderer->framebuffer = set->output;
+
+    if (renderer->flags & LUMINO_FLAG_HEADLESS) {
+        if (renderer->present_callback) {
+            renderer->present_callback(renderer, renderer->present_user);
+        }
+        profile_mark(renderer, LUMINO_STAGE_PRESENT, mark);
+        return;
+    }
+    SDL_UpdateTexture(texture, NULL, set->output, renderer->framebuffer_stride * sizeof(uint32_t));
+    profile_mark(renderer, LUMINO_STAGE_UPLOAD, mark);
+    SDL_RenderClear(sdl_renderer);
+    SDL_RenderCopy(sdl_renderer, texture, NULL, NULL);
+    SDL_RenderPresent(sdl_renderer);
+    profile_mark(renderer, LUMINO_STAGE_PRESENT, mark);
+}
+
+// Submit the frame in the current set, show the previous one while it is
+// upscaled, and continue drawing in the other set
+static void present_pipelined(LuminoRenderer* renderer, uint64_t* mark) {
+    lumino_pipeline* p = renderer->pipeline;
+    present_buffers* set = &p->sets[p->current];
+    present_buffers* next = &p->sets[p->current ^ 1];
+    uint64_t previous = next->fence;
+
+    // the other set is free once the previous frame is upscaled; time spent
+    // waiting here is time the upscale didn't hide
+    pipeline_wait(p, previous);
+    profile_mark(renderer, LUMINO_STAGE_UPSCALE, mark);
+
+    if (set->index) {
+        memcpy(set->palette, lumino_cycle_palette(renderer), sizeof(set->palette));
+    }
+    set->fence = renderer->present_fence;
+    SDL_LockMutex(p->lock);
+    p->in_flight = p->current;
+    p->submitted = set->fence;
+    SDL_CondSignal(p->work_ready);
+    SDL_UnlockMutex(p->lock);
+
+    // the next frame starts from this one, as with a single buffer; both
+    // threads only read set from here on
+    size_t pixels = (size_t)renderer->stride * renderer->internal_height;
+    if (set->index) {
+        memcpy(next->index, set->index, pixels);
+    } else {
+        memcpy(next->internal, set->internal, pixels * sizeof(uint32_t));
+    }
+    renderer->internal_framebuffer = next->internal;
+    renderer->index_buffer = next->index;
+    p->current ^= 1;
+
+    if (previous) {
+        pipeline_show(renderer, previous, mark);
+    }
+}
+
+static int pipeline_init(LuminoRenderer* renderer) {
+    lumino_pipeline* p = (lumino_pipeline*)lumino_arena_calloc(&renderer->persistent_arena, 1, sizeof(lumino_pipeline));
+    if (!p) {
+        return LUMINO_FAILURE;
+    }
+    // set 0 is the renderer's own buffers, set 1 comes from the same arena
+    size_t internal_pixels = (size_t)renderer->stride * renderer->internal_height;
+    p->sets[0].internal = renderer->internal_framebuffer;
+    p->sets[0].index = renderer->index_buffer;
+    p->sets[0].output = renderer->framebuffer;
+    p->sets[1].internal = (uint32_t*)lumino_arena_calloc(&renderer->persistent_arena, internal_pixels, sizeof(uint32_t));
+    if (renderer->index_buffer) {
+        p->sets[1].index = (uint8_t*)lumino_arena_calloc(&renderer->persistent_arena, internal_pixels, sizeof(uint8_t));
+    }
+    p->sets[1].output = (uint32_t*)lumino_arena_alloc(&renderer->persistent_arena,
+        (size_t)renderer->framebuffer_stride * renderer->height * sizeof(uint32_t));
+    if (!p->sets[1].internal || (renderer->index_buffer && !p->sets[1].index) || !p->sets[1].output) {
+        return LUMINO_FAILURE;
+    }
+
+    renderer->pipeline = p;
+    p->lock = SDL_CreateMutex();
+    p->work_ready = SDL_CreateCond();
+    p->work_done = SDL_CreateCond();
+    if (p->lock && p->work_ready && p->work_done) {
+        p->thread = SDL_CreateThread(present_thread, "lumino_present", renderer);
+    }
+    if (!p->thread) {
+        pipeline_destroy(renderer);
+        return LUMINO_FAILURE;
+    }
+    return LUMINO_SUCCESS;
+}
+
+static void pipeline_destroy(LuminoRenderer* renderer) {
+    lumino_pipeline* p = renderer->pipeline;
+    if (!p) {
+        return;
+    }
+    if (p->thread) {
+        pipeline_wait(p, p->submitted);
+        if (renderer->flags & LUMINO_FLAG_HEADLESS) {
+            // offscreen consumers get every frame, the last one included
+            uint64_t mark = renderer->profile ? lumino_profile_now() : 0;
+            pipeline_show(renderer, p->submitted, &mark);
+        }
+        SDL_LockMutex(p->lock);
+        p->quit = 1;
+        SDL_CondSignal(p->work_ready);
+        SDL_UnlockMutex(p->lock);
+        SDL_WaitThread(p->thread, NULL);
+    }
+    if (p->work_done) SDL_DestroyCond(p->work_done);
+    if (p->work_ready) SDL_DestroyCond(p->work_ready);
+    if (p->lock) SDL_DestroyMutex(p->lock);
+    // the buffers go with the persistent arena
+    renderer->pipeline = NULL;
+}
+
+uint64_t lumino_present_fence(const LuminoRenderer* renderer) {
+    return renderer->present_fence;
+}
+
+int lumino_fence_signaled(LuminoRenderer* renderer, uint64_t fence) {
+    lumino_pipeline* p = renderer->pipeline;
+    if (!p) {
+        return 1;
+    }
+    SDL_LockMutex(p->lock);
+    int signaled = p->completed >= fence;
+    SDL_UnlockMutex(p->lock);
+    return signaled;
+}
+
+void lumino_fence_wait(LuminoRenderer* renderer, uint64_t fence) {
+    lumino_pipeline* p = renderer->pipeline;
+    if (!p) {
+        return;
+    }
+    // only submitted frames ever complete
+    if (fence > p->submitted) fence = p->submitted;
+    pipeline_wait(p, fence);
+    SDL_LockMutex(p->lock);
+    uint64_t completed = p->completed;
+    SDL_UnlockMutex(p->lock);
+
+    // show it now rather than at the next present, so framebuffer holds it
+    uint64_t mark = renderer->profile ? lumino_profile_now() : 0;
+    pipeline_show(renderer, completed, &mark);
+}
+
 // Present the framebuffer to the window
 void lumino_present(LuminoRenderer* renderer) {
-    // convert the index buffer to the internal framebuffer
-    //palette_convert(renderer->internal_framebuffer, renderer->index_buffer, (uint8_t*)renderer->palette, renderer->width * renderer->height);
-   
+    // deferred draws are rasterized first, profiled as part of the draw stage
+    lumino_flush(renderer);
+    uint64_t present_start = renderer->profile ? lumino_profile_now() : 0;
+    uint64_t mark = present_start;
+    renderer->present_fence++;
 
-    if(renderer->upscale_fn){
-        // upscale the internal framebuffer to the final framebuffer
-        renderer->upscale_fn(renderer->framebuffer, renderer->internal_framebuffer, renderer->internal_width, renderer->internal_height);
+    if (renderer->pipeline) {
+        present_pipelined(renderer, &mark);
+        if (renderer->profile) {
+            lumino_profile_end_frame(renderer->profile, present_start, mark);
+        }
+        lumino_arena_reset(&renderer->frame_arena);
+        if (!(renderer->flags & LUMINO_FLAG_HEADLESS)) {
+            update_window_title(renderer);
+        }
+        return;
     }
 
-    
-    // copy the framebuffer to the texture (which is actually also a framebuffer)
-    SDL_UpdateTexture(texture, NULL, renderer->framebuffer, renderer->width * sizeof(uint32_t));
+    int partial = 0;
+    if (renderer->flags & LUMINO_FLAG_DIRTY_RECTS) {
+        if (renderer->index_buffer && renderer->palette_cycle_count > 0) {
+            // cycling recolors every pixel
+            SDL_Rect all = { 0, 0, renderer->internal_width, renderer->internal_height };
+            rect_list_add(&renderer->dirty, all);
+        }
+        partial = dirty_rects_partial(renderer);
+    }
+
+    if (renderer->flags & LUMINO_FLAG_HEADLESS) {
+        // offscreen: the frame ends in the framebuffer, no SDL calls, no vsync
+        if (partial) {
+            present_dirty_rects(renderer, &mark);
+        } else {
+            lumino_upscale(renderer);
+            profile_mark(renderer, LUMINO_STAGE_UPSCALE, &mark);
+        }
+        if (renderer->present_callback) {
+            renderer->present_callback(renderer, renderer->present_user);
+        }
+        profile_mark(renderer, LUMINO_STAGE_PRESENT, &mark);
+        if (renderer->profile) {
+            lumino_profile_end_frame(renderer->profile, present_start, mark);
+        }
+        dirty_rects_end_frame(renderer);
+        lumino_arena_reset(&renderer->frame_arena);
+        return;
+    }
+
+    if (partial) {
+        present_dirty_rects(renderer, &mark);
+    } else if (renderer->flags & LUMINO_FLAG_SDL_SCALE) {
+        // upload only the internal buffer, SDL_RenderCopy scales it to the window
+        if (renderer->index_buffer) {
+            // convert the index buffer to the internal framebuffer
+            palette_convert(renderer->internal_framebuffer, renderer->index_buffer, lumino_cycle_palette(renderer), renderer->stride * renderer->internal_height);
+        }
+        profile_mark(renderer, LUMINO_STAGE_UPSCALE, &mark);
+        SDL_UpdateTexture(texture, NULL, renderer->internal_framebuffer, renderer->stride * sizeof(uint32_t));
+        profile_mark(renderer, LUMINO_STAGE_UPLOAD, &mark);
+    } else if (renderer->flags & LUMINO_FLAG_ZERO_COPY) {
+        // upscale straight into the texture memory, honoring its row pitch
+        void* pixels;
+        int pitch;
+        if (SDL_LockTexture(texture, NULL, &pixels, &pitch) == 0) {
+            profile_mark(renderer, LUMINO_STAGE_UPLOAD, &mark);
+            lumino_upscale_to(renderer, (uint32_t*)pixels, pitch / (int)sizeof(uint32_t));
+            profile_mark(renderer, LUMINO_STAGE_UPSCALE, &mark);
+            SDL_UnlockTexture(texture);
+        }
+        profile_mark(renderer, LUMINO_STAGE_UPLOAD, &mark);
+    } else {
+        // upscale the internal framebuffer to the final framebuffer
+        lumino_upscale(renderer);
+        profile_mark(renderer, LUMINO_STAGE_UPSCALE, &mark);
+
+        // copy the framebuffer to the texture (which is actually also a framebuffer)
+        SDL_UpdateTexture(texture, NULL, renderer->framebuffer, renderer->framebuffer_stride * sizeof(uint32_t));
+        profile_mark(renderer, LUMINO_STAGE_UPLOAD, &mark);
+    }
     
     // Clear the back buffer (SDL's internal buffer where the next frame will be drawn)
-    SDL_RenderClear(renderer);
+    SDL_RenderClear(sdl_renderer);
 
     // Copy the texture (which holds the pixel data from the framebuffer) to the renderer's back buffer
     SDL_RenderCopy(sdl_renderer, texture, NULL, NULL);
     
     // Swap the back buffer to the front buffer, making the updated frame visible
     SDL_RenderPresent(sdl_renderer);
+    profile_mark(renderer, LUMINO_STAGE_PRESENT, &mark);
+    if (renderer->profile) {
+        lumino_profile_end_frame(renderer->profile, present_start, mark);
+    }
+    dirty_rects_end_frame(renderer);
+    lumino_arena_reset(&renderer->frame_arena);
+    update_window_title(renderer);
+}
 
+// Once a second: FPS in the window title, plus frame time percentiles when profiling
+static void update_window_title(LuminoRenderer* renderer) {
     frame_count++;
     Uint32 current_time = SDL_GetTicks();
     if (current_time - last_time >= 1000) {
-        // set title to FPS
         char title[256];
-        snprintf(title, sizeof(title), "FPS: %d", frame_count);
+        if (renderer->profile) {
+            snprintf(title, sizeof(title), "FPS: %d | frame p50 %.2f p95 %.2f p99 %.2f ms", frame_count,
+                     lumino_profile_percentile(renderer, LUMINO_STAGE_FRAME, 50.0f),
+                     lumino_profile_percentile(renderer, LUMINO_STAGE_FRAME, 95.0f),
+                     lumino_profile_percentile(renderer, LUMINO_STAGE_FRAME, 99.0f));
+        } else {
+            snprintf(title, sizeof(title), "FPS: %d", frame_count);
+        }
         SDL_SetWindowTitle(window, title);
         frame_count = 0;
         last_time = current_time;
     }
-
 }
 
 void lumino_get_error(int error_code, char* error_message, size_t message_size) {
@@ -11,6 +11,10 @@
 #define UPSCALE_FACTOR 8
 #define SCREEN_WIDTH (WIDTH * UPSCALE_FACTOR)
 #define SCREEN_HEIGHT (HEIGHT * UPSCALE_FACTOR)
+// LUMINO_FLAG_ZERO_COPY / LUMINO_FLAG_SDL_SCALE to compare present paths,
+// LUMINO_FLAG_DEFERRED to rasterize in parallel tiles,
+// LUMINO_FLAG_PIPELINED to upscale on a present thread while the next frame is drawn
+#define INIT_FLAGS 0
 
 int main() {
     LuminoRenderer renderer;
@@ -19,7 +23,7 @@ int main() {
     uint64_t freq = SDL_GetPerformanceFrequency();
 
     // Initialize Lumino renderer
-    if (lumino_init(&renderer, UPSCALE_FACTOR, WIDTH, HEIGHT) != 0) {
+    if (lumino_init_ex(&renderer, UPSCALE_FACTOR, WIDTH, HEIGHT, INIT_FLAGS) != 0) {
         fprintf(stderr, "Failed to initialize renderer\n");
         return 1;
     }
@@ -95,29 +99,33 @@ int main() {
         // Clear screen
         lumino_clear(&renderer);
 
+        // The fire lights the scene: the lightmap is built once per frame
+        // (the flicker changes it) and every lit tile just multiplies by it
+        lumino_set_lights(&renderer, &fire_light, 1, 0.2f);
+
         // Draw grass field by tiling the grass sprite
         for (int y = 0; y < HEIGHT; y += grass.height) {
             for (int x = 0; x < WIDTH; x += grass.width) {
                 grass.x = x;
                 grass.y = y;
-                lumino_draw_sprite_lit(&renderer, grass, fire_light, 0.2f);
+                lumino_draw_sprite_lightmap(&renderer, grass);
             }
         }
 
         // Draw fire sprite and lighting
         lumino_draw_sprite(&renderer, fire);
 
-        // Draw character sprite with ambient lighting only
-        lumino_draw_sprite_lit(&renderer, character, fire_light, 0.2f);
+        // Draw character sprite, lit by the fire as well
+        lumino_draw_sprite_lightmap(&renderer, character);
 
         // Present frame
         lumino_present(&renderer);
     }
 
     // Cleanup
-    free(grass.data);
-    free(fire.data);
-    free(character.data);
+    lumino_sprite_free(&grass);
+    lumino_sprite_free(&fire);
+    lumino_sprite_free(&character);
     lumino_shutdown(&renderer);
     return 0;
 }
@@ -1,10 +1,77 @@
 #include <stdint.h>
+#include <string.h>
 #include "lumino.h"
 #include "primitives.h"
+#include "dispatch.h"
+#include "deferred.h"
+#ifdef __ARM_NEON__
 #include <arm_neon.h>
+#endif
 #include <math.h>
 
+// A line and the range of its steps to draw, see line_window
+typedef struct {
+    int x1, y1, x2, y2;                  // endpoints, in full framebuffer coordinates
+    int ox, oy;                          // where R's origin is in those coordinates
+    int i0, i1;                          // first and last step to draw
+} line_steps;
 
+static void line_scalar(LuminoRenderer* R, const line_steps* l, lumino_color color);
+static void line_scalar_blend(LuminoRenderer* R, const line_steps* l, lumino_color color);
+void lumino_fill_rectangle_scalar(LuminoRenderer* R, int x, int y, int w, int h, lumino_color color);
+void lumino_fill_rectangle_scalar_blend(LuminoRenderer* R, int x, int y, int w, int h, lumino_color color);
+
+typedef void (*line_kernel)(LuminoRenderer* R, const line_steps* l, lumino_color color);
+typedef void (*rect_kernel)(LuminoRenderer* R, int x, int y, int w, int h, lumino_color color);
+
+// Kernel table, scalar until lumino_dispatch_init picks SIMD variants
+static struct {
+    line_kernel line;
+    line_kernel line_blend;
+    rect_kernel fill;
+    rect_kernel fill_blend;
+} kernels = {
+    line_scalar,
+    line_scalar_blend,
+    lumino_fill_rectangle_scalar,
+    lumino_fill_rectangle_scalar_blend,
+};
+
+
+
+//-----------------------
+// Deferred recording
+//-----------------------
+
+// In deferred mode these record the call and return 1, the caller then skips
+// drawing (deferred.h). They cost one NULL check otherwise.
+static inline int defer_rect(LuminoRenderer* R, int op, int x, int y, int w, int h,
+                             lumino_color color, uint8_t index) {
+    if (!R->deferred) return 0;
+    lumino_command* c = lumino_defer(R, op);
+    if (!c) return 0;
+    c->rect.x = x;
+    c->rect.y = y;
+    c->rect.w = w;
+    c->rect.h = h;
+    c->rect.color = color;
+    c->rect.index = index;
+    return 1;
+}
+
+static inline int defer_line(LuminoRenderer* R, int op, int x1, int y1, int x2, int y2,
+                             lumino_color color, uint8_t index) {
+    if (!R->deferred) return 0;
+    lumino_command* c = lumino_defer(R, op);
+    if (!c) return 0;
+    c->line.x1 = x1;
+    c->line.y1 = y1;
+    c->line.x2 = x2;
+    c->line.y2 = y2;
+    c->line.color = color;
+    c->line.index = index;
+    return 1;
+}
 
 //-----------------------
 // Draw Pixel
@@ -16,45 +83,28 @@ void lumino_draw_pixel(LuminoRenderer* renderer, int x, int y, lumino_color colo
     if (x < 0 || x >= renderer->internal_width || y < 0 || y >= renderer->internal_height) {
         return;  // Out of bounds
     }
+    lumino_mark_dirty(renderer, x, y, 1, 1);
+    if (defer_rect(renderer, LUMINO_CMD_PIXEL, x, y, 1, 1, color, 0)) return;
     // Set the pixel color in the index buffer
-    renderer->internal_framebuffer[y * renderer->internal_width + x] = lumino_get_color(color);
+    renderer->internal_framebuffer[y * renderer->stride + x] = lumino_get_color(color);
 }
 
 inline void lumino_draw_pixel_blend(LuminoRenderer* R, int x, int y, lumino_color c) {
     if ((unsigned)x >= (unsigned)R->internal_width ||
         (unsigned)y >= (unsigned)R->internal_height) return;
+    lumino_mark_dirty(R, x, y, 1, 1);
+    if (defer_rect(R, LUMINO_CMD_PIXEL_BLEND, x, y, 1, 1, c, 0)) return;
 
-    uint32_t src = lumino_get_color(c);
-    uint8_t sa = (src >> 24) & 0xFF;
-    // fully transparent?
-    if (sa == 0) return;
-    // fully opaque?
-    if (sa == 255) {
-        R->internal_framebuffer[y * R->internal_width + x] = src;
-        return;
-    }
-
-    uint32_t* p   = &R->internal_framebuffer[y * R->internal_width + x];
-    uint32_t dst  = *p;
-
-    // unpack
-    uint8_t sr =  src        & 0xFF;
-    uint8_t sg = (src >>  8) & 0xFF;
-    uint8_t sb = (src >> 16) & 0xFF;
-    uint8_t dr =  dst        & 0xFF;
-    uint8_t dg = (dst >>  8) & 0xFF;
-    uint8_t db = (dst >> 16) & 0xFF;
-    uint8_t da = (dst >> 24) & 0xFF;
-
-    // integer src-over: out = (s*Sa + d*(255−Sa)) / 255
-    uint8_t inv = 255 - sa;
-    uint8_t out_r = (uint8_t)((sr * sa + dr * inv + 127) / 255);
-    uint8_t out_g = (uint8_t)((sg * sa + dg * inv + 127) / 255);
-    uint8_t out_b = (uint8_t)((sb * sa + db * inv + 127) / 255);
-    // composite alpha: Aout = Sa + Da*(1−Sa)
-    uint8_t out_a = (uint8_t)(sa + (da * inv + 127) / 255);
+    uint32_t* p = &R->internal_framebuffer[y * R->stride + x];
+    // integer src-over: out = (s*Sa + d*(255-Sa)) / 255
+    *p = lumino_blend_packed(*p, lumino_get_color(c));
+}
 
-    *p = lumino_get_color((lumino_color){ out_r, out_g, out_b, out_a });
+// a line dirties its bounding box
+static inline void mark_line_dirty(LuminoRenderer* R, int x1, int y1, int x2, int y2) {
+    int x0 = x1 < x2 ? x1 : x2;
+    int y0 = y1 < y2 ? y1 : y2;
+    lumino_mark_dirty(R, x0, y0, abs(x2 - x1) + 1, abs(y2 - y1) + 1);
 }
 
 
@@ -63,61 +113,125 @@ inline void lumino_draw_pixel_blend(LuminoRenderer* R, int x, int y, lumino_colo
 // Draw Line
 //------------------------
 
-// Draw a line from (x1, y1) to (x2, y2) with a color
-void lumino_draw_line_scalar(LuminoRenderer* renderer, int x1, int y1, int x2, int y2, lumino_color color) {
-    // Bresenham's line algorithm
+// Steps of the line (x1, y1)-(x2, y2) whose major coordinate lands inside R,
+// R's origin being at (ox, oy). Both the Bresenham and the NEON walks move
+// along the major axis by exactly one pixel per step, so the range holds for
+// every kernel: a tile view replays only its part of a long line, from the
+// original endpoints, and gets the same pixels as drawing it whole. 0 if empty.
+static int line_window(const LuminoRenderer* R, int x1, int y1, int x2, int y2,
+                       int ox, int oy, line_steps* l) {
     int dx = abs(x2 - x1);
     int dy = abs(y2 - y1);
-    int sx = (x1 < x2) ? 1 : -1;
-    int sy = (y1 < y2) ? 1 : -1;
-    int err = dx - dy;
+    int steps = dx > dy ? dx : dy;
+
+    // major axis start, direction and R's range on it
+    long long a, lo, hi;
+    int s;
+    if (dx >= dy) {
+        a = x1; s = x1 < x2 ? 1 : -1; lo = ox; hi = (long long)ox + R->internal_width - 1;
+    } else {
+        a = y1; s = y1 < y2 ? 1 : -1; lo = oy; hi = (long long)oy + R->internal_height - 1;
+    }
+    long long i0 = s > 0 ? lo - a : a - hi;
+    long long i1 = s > 0 ? hi - a : a - lo;
+    if (i0 < 0) i0 = 0;
+    if (i1 > steps) i1 = steps;
+    if (i0 > i1) return 0;
+
+    l->x1 = x1; l->y1 = y1;
+    l->x2 = x2; l->y2 = y2;
+    l->ox = ox; l->oy = oy;
+    l->i0 = (int)i0;
+    l->i1 = (int)i1;
+    return 1;
+}
 
-    while (1) {
-        lumino_draw_pixel(renderer, x1, y1, color);
-        if (x1 == x2 && y1 == y2) break;
+// Bresenham over steps i0..i1 of the line. The walk starts at step i0 in
+// closed form: by then the minor axis has moved (2*minor*i0 + major - 1) /
+// (2*major) times, which is where the loop from (x1, y1) would be.
+// op picks the pixel write (LUMINO_CMD_LINE, _LINE_BLEND or _LINE_INDEX).
+static inline void line_walk_scalar(LuminoRenderer* R, const line_steps* l, int op,
+                                    uint32_t packed, uint8_t index) {
+    int dx = abs(l->x2 - l->x1);
+    int dy = abs(l->y2 - l->y1);
+    int sx = (l->x1 < l->x2) ? 1 : -1;
+    int sy = (l->y1 < l->y2) ? 1 : -1;
+
+    long long i = l->i0, m;
+    int x, y, err;
+    if (dx >= dy) {
+        m = dx ? (2LL * dy * i + dx - 1) / (2LL * dx) : 0;
+        x = l->x1 + sx * (int)i;
+        y = l->y1 + sy * (int)m;
+        err = (int)((long long)dx * (1 + m) - (long long)dy * (1 + i));
+    } else {
+        m = (2LL * dx * i + dy - 1) / (2LL * dy);
+        x = l->x1 + sx * (int)m;
+        y = l->y1 + sy * (int)i;
+        err = (int)((long long)dx * (1 + i) - (long long)dy * (1 + m));
+    }
+    // from here on in R's coordinates
+    x -= l->ox;
+    y -= l->oy;
+
+    for (int step = l->i0; ; step++) {
+        if ((unsigned)x < (unsigned)R->internal_width &&
+            (unsigned)y < (unsigned)R->internal_height) {
+            if (op == LUMINO_CMD_LINE_INDEX) {
+                R->index_buffer[y * R->stride + x] = index;
+            } else if (op == LUMINO_CMD_LINE_BLEND) {
+                uint32_t* p = &R->internal_framebuffer[y * R->stride + x];
+                *p = lumino_blend_packed(*p, packed);
+            } else {
+                R->internal_framebuffer[y * R->stride + x] = packed;
+            }
+        }
+        if (step == l->i1) break;
         int err2 = err * 2;
         if (err2 > -dy) {
             err -= dy;
-            x1 += sx;
+            x += sx;
         }
         if (err2 < dx) {
             err += dx;
-            y1 += sy;
+            y += sy;
         }
     }
 }
-void lumino_draw_line_scalar_blend(LuminoRenderer* renderer, int x1, int y1, int x2, int y2, lumino_color color) {
-    // Bresenham's line algorithm
-    int dx = abs(x2 - x1);
-    int dy = abs(y2 - y1);
-    int sx = (x1 < x2) ? 1 : -1;
-    int sy = (y1 < y2) ? 1 : -1;
-    int err = dx - dy;
 
-    while (1) {
-        lumino_draw_pixel_blend(renderer, x1, y1, color);
-        if (x1 == x2 && y1 == y2) break;
-        int err2 = err * 2;
-        if (err2 > -dy) {
-            err -= dy;
-            x1 += sx;
-        }
-        if (err2 < dx) {
-            err += dx;
-            y1 += sy;
-        }
+static void line_scalar(LuminoRenderer* R, const line_steps* l, lumino_color color) {
+    line_walk_scalar(R, l, LUMINO_CMD_LINE, lumino_get_color(color), 0);
+}
+
+static void line_scalar_blend(LuminoRenderer* R, const line_steps* l, lumino_color color) {
+    line_walk_scalar(R, l, LUMINO_CMD_LINE_BLEND, lumino_get_color(color), 0);
+}
+
+void lumino_draw_line_scalar_blend(LuminoRenderer* renderer, int x1, int y1, int x2, int y2, lumino_color color) {
+    line_steps l;
+    if (line_window(renderer, x1, y1, x2, y2, 0, 0, &l)) {
+        line_scalar_blend(renderer, &l, color);
     }
 }
 
 
+#ifdef __ARM_NEON__
+// Float stepping, 4 steps at a time: step t is at round(x1 + t*dx, y1 + t*dy)
+// with the per-step deltas of the whole line, so any i0..i1 window of it
+// rounds exactly like the full walk. Lanes past i1 are skipped.
+static inline void line_walk_neon(LuminoRenderer* R, const line_steps* l, int blend, uint32_t packed) {
+    int x0 = l->x1, y0 = l->y1, x1 = l->x2, y1 = l->y2;
+    int width = R->internal_width, height = R->internal_height;
+    int stride = R->stride;
+    uint32_t* fb = R->internal_framebuffer;
 
-void lumino_draw_line_neon(LuminoRenderer* R,
-                           int x0, int y0, int x1, int y1,
-                           lumino_color color)
-{
     int steps = (int)fmaxf(fabsf(x1 - x0), fabsf(y1 - y0));
     if (steps == 0) {
-        lumino_draw_pixel(R, x0, y0, color);
+        int xx = x0 - l->ox, yy = y0 - l->oy;
+        if ((unsigned)xx < (unsigned)width && (unsigned)yy < (unsigned)height) {
+            uint32_t* p = &fb[yy * stride + xx];
+            *p = blend ? lumino_blend_packed(*p, packed) : packed;
+        }
         return;
     }
 
@@ -128,14 +242,8 @@ void lumino_draw_line_neon(LuminoRenderer* R,
     float32x4_t x0_v = vdupq_n_f32((float)x0);
     float32x4_t y0_v = vdupq_n_f32((float)y0);
 
-    uint32_t packed = lumino_get_color(color);
-    uint32x4_t pack_v = vdupq_n_u32(packed);
-
-    int width = R->internal_width, height = R->internal_height;
-    uint32_t* fb = R->internal_framebuffer;
-
-    for (int i = 0; i <= steps; i += 4) {
-        float32x4_t t = { (float)i, (float)(i+1), (float)(i+2), (float)(i+3) };
+    for (int i = l->i0; i <= l->i1; i += 4) {
+        float32x4_t t = { (float)i, (float)(i + 1), (float)(i + 2), (float)(i + 3) };
         float32x4_t xf = vmlaq_f32(x0_v, t, dx_v);
         float32x4_t yf = vmlaq_f32(y0_v, t, dy_v);
 
@@ -146,87 +254,61 @@ void lumino_draw_line_neon(LuminoRenderer* R,
         vst1q_s32(xs, xi);
         vst1q_s32(ys, yi);
 
-        for (int j = 0; j < 4; j++) {
-            int xx = xs[j], yy = ys[j];
+        for (int j = 0; j < 4 && i + j <= l->i1; j++) {
+            int xx = xs[j] - l->ox, yy = ys[j] - l->oy;
             if ((unsigned)xx < (unsigned)width &&
                 (unsigned)yy < (unsigned)height)
             {
-                fb[yy * width + xx] = packed;
+                uint32_t* p = &fb[yy * stride + xx];
+                *p = blend ? lumino_blend_packed(*p, packed) : packed;
             }
         }
     }
 }
 
-void lumino_draw_line_neon_blend(LuminoRenderer* R,
-                                 int x0, int y0, int x1, int y1,
-                                 lumino_color color)
-{
-    int steps = (int)fmaxf(fabsf(x1 - x0), fabsf(y1 - y0));
-    if (steps == 0) {
-        lumino_draw_pixel_blend(R, x0, y0, color);
-        return;
-    }
-
-    // Compute delta per step
-    float dx = (x1 - x0) / (float)steps;
-    float dy = (y1 - y0) / (float)steps;
-    float32x4_t dx_v  = vdupq_n_f32(dx);
-    float32x4_t dy_v  = vdupq_n_f32(dy);
-    float32x4_t x0_v  = vdupq_n_f32((float)x0);
-    float32x4_t y0_v  = vdupq_n_f32((float)y0);
-
-    // We'll generate t = [i, i+1, i+2, i+3] each loop
-    // and step i by 4 each iteration
-    for (int i = 0; i <= steps; i += 4) {
-        // build a vector [i, i+1, i+2, i+3]
-        float32x4_t t = { (float)i,
-                          (float)(i + 1 <= steps ? i + 1 : steps),
-                          (float)(i + 2 <= steps ? i + 2 : steps),
-                          (float)(i + 3 <= steps ? i + 3 : steps) };
-
-        // x = x0 + t*dx, y = y0 + t*dy
-        float32x4_t xf = vmlaq_f32(x0_v, t, dx_v);
-        float32x4_t yf = vmlaq_f32(y0_v, t, dy_v);
-
-        // round to nearest integer
-        int32x4_t xi = vcvtq_s32_f32(vrndnq_f32(xf));
-        int32x4_t yi = vcvtq_s32_f32(vrndnq_f32(yf));
-
-        // store lanes to arrays
-        int32_t xs[4], ys[4];
-        vst1q_s32(xs, xi);
-        vst1q_s32(ys, yi);
-
-        // blend each pixel
-        for (int j = 0; j < 4; j++) {
-            int xx = xs[j], yy = ys[j];
-            // check bounds once per point
-            if ((unsigned)xx < (unsigned)R->internal_width &&
-                (unsigned)yy < (unsigned)R->internal_height)
-            {
-                lumino_draw_pixel_blend(R, xx, yy, color);
-            }
-        }
-    }
+static void line_neon(LuminoRenderer* R, const line_steps* l, lumino_color color) {
+    line_walk_neon(R, l, 0, lumino_get_color(color));
 }
 
+static void line_neon_blend(LuminoRenderer* R, const line_steps* l, lumino_color color) {
+    line_walk_neon(R, l, 1, lumino_get_color(color));
+}
+#endif
 
-
-    
 void lumino_draw_line(LuminoRenderer* renderer, int x1, int y1, int x2, int y2, lumino_color color) {
-    #if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
-        lumino_draw_line_neon(renderer, x1, y1, x2, y2, color);
-    #else
-        lumino_draw_line_scalar(renderer, x1, y1, x2, y2, color);
-    #endif
+    mark_line_dirty(renderer, x1, y1, x2, y2);
+    if (defer_line(renderer, LUMINO_CMD_LINE, x1, y1, x2, y2, color, 0)) return;
+    line_steps l;
+    if (line_window(renderer, x1, y1, x2, y2, 0, 0, &l)) {
+        kernels.line(renderer, &l, color);
+    }
 }
 
 void lumino_draw_line_blend(LuminoRenderer* renderer, int x1, int y1, int x2, int y2, lumino_color color) {
-    #if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
-        lumino_draw_line_neon_blend(renderer, x1, y1, x2, y2, color);
-    #else
-        lumino_draw_line_scalar_blend(renderer, x1, y1, x2, y2, color);
-    #endif
+    mark_line_dirty(renderer, x1, y1, x2, y2);
+    if (defer_line(renderer, LUMINO_CMD_LINE_BLEND, x1, y1, x2, y2, color, 0)) return;
+    line_steps l;
+    if (line_window(renderer, x1, y1, x2, y2, 0, 0, &l)) {
+        kernels.line_blend(renderer, &l, color);
+    }
+}
+
+// Deferred replay (deferred.h): the line keeps its recorded endpoints and only
+// the steps inside the tile are walked
+void lumino_replay_line(LuminoRenderer* view, const lumino_command* c, int tx, int ty) {
+    line_steps l;
+    if (!line_window(view, c->line.x1, c->line.y1, c->line.x2, c->line.y2, tx, ty, &l)) return;
+    switch (c->op) {
+        case LUMINO_CMD_LINE:
+            kernels.line(view, &l, c->line.color);
+            break;
+        case LUMINO_CMD_LINE_BLEND:
+            kernels.line_blend(view, &l, c->line.color);
+            break;
+        default:
+            line_walk_scalar(view, &l, LUMINO_CMD_LINE_INDEX, 0, c->line.index);
+            break;
+    }
 }
 
 //------------------------
@@ -253,7 +335,7 @@ void lumino_fill_rectangle_scalar(LuminoRenderer* R,
                            lumino_color color)
 {
     uint32_t packed = lumino_get_color(color);
-    int fbw = R->internal_width;
+    int fbw = R->stride;
     uint32_t* buf = R->internal_framebuffer;
 
     for (int row = 0; row < h; row++) {
@@ -264,32 +346,56 @@ void lumino_fill_rectangle_scalar(LuminoRenderer* R,
     }
 }
 
+// Clip a blend fill to the framebuffer once per rect. Returns 0 when nothing
+// is left to draw.
+static inline int clip_rect(const LuminoRenderer* R, int* x, int* y, int* w, int* h) {
+    int x0 = *x < 0 ? 0 : *x;
+    int y0 = *y < 0 ? 0 : *y;
+    int x1 = *x + *w > R->internal_width  ? R->internal_width  : *x + *w;
+    int y1 = *y + *h > R->internal_height ? R->internal_height : *y + *h;
+    if (x0 >= x1 || y0 >= y1) return 0;
+    *x = x0; *y = y0; *w = x1 - x0; *h = y1 - y0;
+    return 1;
+}
+
+// The source is constant, so s*Sa + 127 is computed once per rect in 16-bit
+// lanes (one pixel per 64 bits, alpha lane uses 255 as its source factor) and
+// each pixel costs d*(255-Sa), an add and the div255 of dispatch.h.
+// Bit-exact with lumino_blend_packed, Sa == 0 and 255 included.
+static inline uint64_t blend_src_terms(uint32_t packed) {
+    uint64_t sa = packed >> 24;
+    return ((packed & 0xFF) * sa + 127) |
+           ((((packed >> 8) & 0xFF) * sa + 127) << 16) |
+           ((((packed >> 16) & 0xFF) * sa + 127) << 32) |
+           ((255 * sa + 127) << 48);
+}
+
 // fill rectangle with blending
 void lumino_fill_rectangle_scalar_blend(LuminoRenderer* R,
                                         int x, int y, int w, int h,
                                         lumino_color color)
 {
-    int fbw = R->internal_width;
-    uint32_t* buf = R->internal_framebuffer;
+    uint32_t packed = lumino_get_color(color);
+    if ((packed >> 24) == 0 || !clip_rect(R, &x, &y, &w, &h)) return;
+    int fbw = R->stride;
 
     for (int row = 0; row < h; row++) {
-        int yy = y + row;
+        uint32_t* dst = R->internal_framebuffer + (y + row) * fbw + x;
         for (int i = 0; i < w; i++) {
-            int xx = x + i;
-            lumino_draw_pixel_blend(R, xx, yy, color);
+            dst[i] = lumino_blend_packed(dst[i], packed);
         }
     }
 }
 
 
-
+#ifdef __ARM_NEON__
 void lumino_fill_rectangle_neon(LuminoRenderer* R,
                            int x, int y, int w, int h,
                            lumino_color color)
 {
     uint32_t packed = lumino_get_color(color);
     uint32x4_t pack_v = vdupq_n_u32(packed);
-    int fbw = R->internal_width;
+    int fbw = R->stride;
     uint32_t* buf = R->internal_framebuffer;
 
     for (int row = 0; row < h; row++) {
@@ -306,59 +412,22 @@ void lumino_fill_rectangle_neon(LuminoRenderer* R,
     }
 }
 
-// Blend‐fill a single scanline of length count at dst[], blending packed_src over existing pixels.
-static void blend_row_neon(uint32_t* dst, int count, uint32_t packed_src) {
-    // unpack source RGBA into 8-bit lanes
-    uint8_t sa = (packed_src >> 24) & 0xFF;
-    // prepare NEON vectors
-    uint32x4_t src_u32 = vdupq_n_u32(packed_src);
-    uint8x16_t src_u8  = vreinterpretq_u8_u32(src_u32);
-    uint16x8_t alpha   = vdupq_n_u16(sa);
-    uint16x8_t inv_a   = vdupq_n_u16(255 - sa);
-
+// Blend-fill one row: sf holds s*Sa + 127 per channel (blend_src_terms) and
+// ia 255 - Sa, so each channel is div255(d*ia + sf) like lumino_blend_packed
+static void blend_row_neon(uint32_t* dst, int count, uint32_t packed_src,
+                           uint16x8_t sf, uint16x8_t ia) {
     int i = 0;
     for (; i <= count - 4; i += 4) {
-        // load 4 destination pixels
-        uint32x4_t dst_u32 = vld1q_u32(dst + i);
-        uint8x16_t dst_u8  = vreinterpretq_u8_u32(dst_u32);
-
-        // widen to 16 bits
-        uint16x8_t dst_lo = vmovl_u8(vget_low_u8(dst_u8));
-        uint16x8_t dst_hi = vmovl_u8(vget_high_u8(dst_u8));
-        uint16x8_t src_lo = vmovl_u8(vget_low_u8(src_u8));
-        uint16x8_t src_hi = vmovl_u8(vget_high_u8(src_u8));
-
-        // compute blended = (src*α + dst*(255-α)) >> 8
-        uint16x8_t out_lo = vshrq_n_u16(
-            vaddq_u16(vmulq_u16(src_lo, alpha), vmulq_u16(dst_lo, inv_a)),
-            8
-        );
-        uint16x8_t out_hi = vshrq_n_u16(
-            vaddq_u16(vmulq_u16(src_hi, alpha), vmulq_u16(dst_hi, inv_a)),
-            8
-        );
-
-        // narrow back to bytes and store
-        uint8x8_t  o_lo8 = vmovn_u16(out_lo);
-        uint8x8_t  o_hi8 = vmovn_u16(out_hi);
-        uint8x16_t out_u8 = vcombine_u8(o_lo8, o_hi8);
-        vst1q_u32(dst + i, vreinterpretq_u32_u8(out_u8));
+        uint8x16_t d = vreinterpretq_u8_u32(vld1q_u32(dst + i));
+        uint16x8_t lo = vmlaq_u16(sf, vmovl_u8(vget_low_u8(d)), ia);
+        uint16x8_t hi = vmlaq_u16(sf, vmovl_u8(vget_high_u8(d)), ia);
+        uint8x16_t out = vcombine_u8(vmovn_u16(lumino_div255_epu16_neon(lo)),
+                                     vmovn_u16(lumino_div255_epu16_neon(hi)));
+        vst1q_u32(dst + i, vreinterpretq_u32_u8(out));
     }
-
-    // tail pixels: scalar blend
+    // Remainder
     for (; i < count; i++) {
-        // unpack dest
-        uint32_t d = dst[i];
-        uint8_t dr = d & 0xFF, dg = (d>>8)&0xFF, db = (d>>16)&0xFF, da = (d>>24)&0xFF;
-        // unpack src
-        uint8_t sr = packed_src & 0xFF, sg = (packed_src>>8)&0xFF, sb = (packed_src>>16)&0xFF;
-        // blend
-        float af = sa/255.0f, invf = 1.0f - af;
-        uint8_t rr = (uint8_t)(sr*af + dr*invf + .5f);
-        uint8_t gg = (uint8_t)(sg*af + dg*invf + .5f);
-        uint8_t bb = (uint8_t)(sb*af + db*invf + .5f);
-        uint8_t aa = (uint8_t)(sa + da*invf + .5f);
-        dst[i] = (aa<<24)|(bb<<16)|(gg<<8)|rr;
+        dst[i] = lumino_blend_packed(dst[i], packed_src);
     }
 }
 
@@ -368,28 +437,243 @@ void lumino_fill_rectangle_neon_blend(LuminoRenderer* R,
                                  lumino_color color)
 {
     uint32_t packed = lumino_get_color(color);
-    int fbw = R->internal_width;
+    uint32_t sa = packed >> 24;
+    if (sa == 0 || !clip_rect(R, &x, &y, &w, &h)) return;
+    if (sa == 255) {
+        lumino_fill_rectangle_neon(R, x, y, w, h, color);
+        return;
+    }
+    uint16x8_t sf = vreinterpretq_u16_u64(vdupq_n_u64(blend_src_terms(packed)));
+    uint16x8_t ia = vdupq_n_u16((uint16_t)(255 - sa));
+    int fbw = R->stride;
     uint32_t* base = R->internal_framebuffer + y*fbw + x;
 
     for (int row = 0; row < h; row++) {
-        blend_row_neon(base + row*fbw, w, packed);
+        blend_row_neon(base + row*fbw, w, packed, sf, ia);
     }
 }
+#endif
+
+#if defined(LUMINO_X86)
+LUMINO_TARGET_AVX2
+static void lumino_fill_rectangle_avx2(LuminoRenderer* R,
+                                       int x, int y, int w, int h,
+                                       lumino_color color)
+{
+    uint32_t packed = lumino_get_color(color);
+    __m256i pack_v = _mm256_set1_epi32((int)packed);
+    int fbw = R->stride;
+    uint32_t* buf = R->internal_framebuffer;
+
+    for (int row = 0; row < h; row++) {
+        uint32_t* dst = buf + (y + row) * fbw + x;
+        int i = 0;
+        // rows start 64-byte aligned, so the same few head pixels line
+        // every row up for aligned stores
+        for (; i < w && ((uintptr_t)(dst + i) & 31); i++) {
+            dst[i] = packed;
+        }
+        // SIMD store 8 pixels at a time
+        for (; i <= w - 8; i += 8) {
+            _mm256_store_si256((__m256i*)(dst + i), pack_v);
+        }
+        // Remainder
+        for (; i < w; i++) {
+            dst[i] = packed;
+        }
+    }
+}
+
+LUMINO_TARGET_SSE2
+static void lumino_fill_rectangle_sse2(LuminoRenderer* R,
+                                       int x, int y, int w, int h,
+                                       lumino_color color)
+{
+    uint32_t packed = lumino_get_color(color);
+    __m128i pack_v = _mm_set1_epi32((int)packed);
+    int fbw = R->stride;
+    uint32_t* buf = R->internal_framebuffer;
+
+    for (int row = 0; row < h; row++) {
+        uint32_t* dst = buf + (y + row) * fbw + x;
+        int i = 0;
+        for (; i < w && ((uintptr_t)(dst + i) & 15); i++) {
+            dst[i] = packed;
+        }
+        // SIMD store 4 pixels at a time
+        for (; i <= w - 4; i += 4) {
+            _mm_store_si128((__m128i*)(dst + i), pack_v);
+        }
+        // Remainder
+        for (; i < w; i++) {
+            dst[i] = packed;
+        }
+    }
+}
+
+LUMINO_TARGET_AVX2
+static void lumino_fill_rectangle_avx2_blend(LuminoRenderer* R,
+                                             int x, int y, int w, int h,
+                                             lumino_color color)
+{
+    uint32_t packed = lumino_get_color(color);
+    uint32_t sa = packed >> 24;
+    if (sa == 0 || !clip_rect(R, &x, &y, &w, &h)) return;
+    if (sa == 255) {
+        lumino_fill_rectangle_avx2(R, x, y, w, h, color);
+        return;
+    }
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i sf = _mm256_set1_epi64x((long long)blend_src_terms(packed));
+    const __m256i ia = _mm256_set1_epi16((short)(255 - sa));
+    int fbw = R->stride;
+
+    for (int row = 0; row < h; row++) {
+        uint32_t* dst = R->internal_framebuffer + (y + row) * fbw + x;
+        int i = 0;
+        for (; i <= w - 8; i += 8) {
+            __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+            __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ia), sf);
+            __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ia), sf);
+            _mm256_storeu_si256((__m256i*)(dst + i),
+                                _mm256_packus_epi16(lumino_div255_epu16_avx2(lo),
+                                                    lumino_div255_epu16_avx2(hi)));
+        }
+        // Remainder
+        for (; i < w; i++) {
+            dst[i] = lumino_blend_packed(dst[i], packed);
+        }
+    }
+}
+
+LUMINO_TARGET_SSE2
+static void lumino_fill_rectangle_sse2_blend(LuminoRenderer* R,
+                                             int x, int y, int w, int h,
+                                             lumino_color color)
+{
+    uint32_t packed = lumino_get_color(color);
+    uint32_t sa = packed >> 24;
+    if (sa == 0 || !clip_rect(R, &x, &y, &w, &h)) return;
+    if (sa == 255) {
+        lumino_fill_rectangle_sse2(R, x, y, w, h, color);
+        return;
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sf = _mm_set1_epi64x((long long)blend_src_terms(packed));
+    const __m128i ia = _mm_set1_epi16((short)(255 - sa));
+    int fbw = R->stride;
+
+    for (int row = 0; row < h; row++) {
+        uint32_t* dst = R->internal_framebuffer + (y + row) * fbw + x;
+        int i = 0;
+        for (; i <= w - 4; i += 4) {
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia), sf);
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia), sf);
+            _mm_storeu_si128((__m128i*)(dst + i),
+                             _mm_packus_epi16(lumino_div255_epu16_sse2(lo),
+                                              lumino_div255_epu16_sse2(hi)));
+        }
+        // Remainder
+        for (; i < w; i++) {
+            dst[i] = lumino_blend_packed(dst[i], packed);
+        }
+    }
+}
+#endif
 
 
 
 void lumino_fill_rectangle(LuminoRenderer* renderer, int x, int y, int width, int height, lumino_color color) {
-    #if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
-        lumino_fill_rectangle_neon(renderer, x, y, width, height, color);
-    #else
-        lumino_fill_rectangle_scalar(renderer, x, y, width, height, color);
-    #endif
+    lumino_mark_dirty(renderer, x, y, width, height);
+    if (defer_rect(renderer, LUMINO_CMD_FILL, x, y, width, height, color, 0)) return;
+    kernels.fill(renderer, x, y, width, height, color);
 }
 
 void lumino_fill_rectangle_blend(LuminoRenderer* renderer, int x, int y, int width, int height, lumino_color color) {
-    #if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
-        lumino_fill_rectangle_neon_blend(renderer, x, y, width, height, color);
-    #else
-        lumino_fill_rectangle_scalar_blend(renderer, x, y, width, height, color);
-    #endif
-}
\ No newline at end of file
+    lumino_mark_dirty(renderer, x, y, width, height);
+    if (defer_rect(renderer, LUMINO_CMD_FILL_BLEND, x, y, width, height, color, 0)) return;
+    kernels.fill_blend(renderer, x, y, width, height, color);
+}
+
+
+//--------------------------
+// Kernel selection
+//--------------------------
+
+// Lines are scattered single-pixel writes, so x86 keeps the scalar Bresenham
+// for every level; only the fills (plain and blended) have wide kernels there.
+void lumino_primitives_select_kernels(int level) {
+    kernels.line       = line_scalar;
+    kernels.line_blend = line_scalar_blend;
+    kernels.fill       = lumino_fill_rectangle_scalar;
+    kernels.fill_blend = lumino_fill_rectangle_scalar_blend;
+
+    switch (level) {
+#if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
+        case LUMINO_SIMD_NEON:
+            kernels.line       = line_neon;
+            kernels.line_blend = line_neon_blend;
+            kernels.fill       = lumino_fill_rectangle_neon;
+            kernels.fill_blend = lumino_fill_rectangle_neon_blend;
+            break;
+#endif
+#if defined(LUMINO_X86)
+        case LUMINO_SIMD_AVX2:
+            kernels.fill       = lumino_fill_rectangle_avx2;
+            kernels.fill_blend = lumino_fill_rectangle_avx2_blend;
+            break;
+        case LUMINO_SIMD_SSE2:
+            kernels.fill       = lumino_fill_rectangle_sse2;
+            kernels.fill_blend = lumino_fill_rectangle_sse2_blend;
+            break;
+#endif
+        default:
+            break;
+    }
+}
+
+
+//--------------------------
+// Indexed drawing
+//--------------------------
+
+void lumino_draw_pixel_index(LuminoRenderer* R, int x, int y, uint8_t index) {
+    if ((unsigned)x >= (unsigned)R->internal_width ||
+        (unsigned)y >= (unsigned)R->internal_height) return;
+    lumino_mark_dirty(R, x, y, 1, 1);
+    if (defer_rect(R, LUMINO_CMD_PIXEL_INDEX, x, y, 1, 1, (lumino_color){0, 0, 0, 0}, index)) return;
+    R->index_buffer[y * R->stride + x] = index;
+}
+
+void lumino_draw_line_index(LuminoRenderer* R, int x1, int y1, int x2, int y2, uint8_t index) {
+    mark_line_dirty(R, x1, y1, x2, y2);
+    if (defer_line(R, LUMINO_CMD_LINE_INDEX, x1, y1, x2, y2, (lumino_color){0, 0, 0, 0}, index)) return;
+    line_steps l;
+    if (line_window(R, x1, y1, x2, y2, 0, 0, &l)) {
+        line_walk_scalar(R, &l, LUMINO_CMD_LINE_INDEX, 0, index);
+    }
+}
+
+void lumino_draw_rectangle_index(LuminoRenderer* R, int x, int y, int width, int height, uint8_t index) {
+    lumino_draw_line_index(R, x, y, x + width - 1, y, index);                            // Top
+    lumino_draw_line_index(R, x, y, x, y + height - 1, index);                           // Left
+    lumino_draw_line_index(R, x + width - 1, y, x + width - 1, y + height - 1, index);   // Right
+    lumino_draw_line_index(R, x, y + height - 1, x + width - 1, y + height - 1, index);  // Bottom
+}
+
+void lumino_fill_rectangle_index(LuminoRenderer* R, int x, int y, int w, int h, uint8_t index) {
+    // clip to the buffer, then each row is a single memset
+    int x0 = x < 0 ? 0 : x;
+    int y0 = y < 0 ? 0 : y;
+    int x1 = x + w > R->internal_width  ? R->internal_width  : x + w;
+    int y1 = y + h > R->internal_height ? R->internal_height : y + h;
+    if (x0 >= x1 || y0 >= y1) return;
+    lumino_mark_dirty(R, x0, y0, x1 - x0, y1 - y0);
+    if (defer_rect(R, LUMINO_CMD_FILL_INDEX, x0, y0, x1 - x0, y1 - y0, (lumino_color){0, 0, 0, 0}, index)) return;
+
+    int fbw = R->stride;
+    for (int row = y0; row < y1; row++) {
+        memset(R->index_buffer + row * fbw + x0, index, x1 - x0);
+    }
+}
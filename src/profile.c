@@ -0,0 +1,175 @@
+// profile.c - per-frame stage timings, percentiles, CSV and overlay
+
+#include "profile.h"
+#include "deferred.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct lumino_profile {
+    uint64_t frame_start;                        // end of the previous present
+    uint64_t current[LUMINO_STAGE_COUNT];        // ns accumulated in the open frame
+
+    // ring of closed frames, in ns
+    uint64_t history[LUMINO_PROFILE_FRAMES][LUMINO_STAGE_COUNT];
+    int next;                                    // slot the next frame goes to
+    int count;                                   // valid frames, up to LUMINO_PROFILE_FRAMES
+    uint64_t frame_index;                        // frames closed since enabling
+};
+
+static const char* stage_names[LUMINO_STAGE_COUNT] = {
+    "clear", "draw", "upscale", "upload", "present", "frame"
+};
+
+// overlay colors of the measured stages (not FRAME), packed like lumino_get_color
+static const uint32_t stage_colors[LUMINO_STAGE_FRAME] = {
+    0xFF808080, 0xFF40C040, 0xFF4080FF, 0xFFFFC040, 0xFFC040C0
+};
+
+uint64_t lumino_profile_now(void) {
+    static uint64_t freq = 0;
+    if (!freq) freq = SDL_GetPerformanceFrequency();
+    uint64_t t = SDL_GetPerformanceCounter();
+    return (t / freq) * 1000000000ull + (t % freq) * 1000000000ull / freq;
+}
+
+int lumino_profile_enable(LuminoRenderer* renderer, int enable) {
+    if (!enable) {
+        lumino_profile_destroy(renderer->profile);
+        renderer->profile = NULL;
+        return LUMINO_SUCCESS;
+    }
+    if (renderer->profile) {
+        return LUMINO_SUCCESS;
+    }
+    lumino_profile* profile = (lumino_profile*)calloc(1, sizeof(lumino_profile));
+    if (!profile) {
+        return LUMINO_FAILURE;
+    }
+    profile->frame_start = lumino_profile_now();
+    renderer->profile = profile;
+    return LUMINO_SUCCESS;
+}
+
+void lumino_profile_destroy(lumino_profile* profile) {
+    free(profile);
+}
+
+void lumino_profile_add(lumino_profile* profile, int stage, uint64_t start, uint64_t end) {
+    profile->current[stage] += end - start;
+}
+
+void lumino_profile_end_frame(lumino_profile* profile, uint64_t present_start, uint64_t present_end) {
+    // whatever the clear didn't take before present was spent drawing
+    uint64_t before_present = present_start - profile->frame_start;
+    uint64_t clear = profile->current[LUMINO_STAGE_CLEAR];
+    profile->current[LUMINO_STAGE_DRAW] = before_present > clear ? before_present - clear : 0;
+    profile->current[LUMINO_STAGE_FRAME] = present_end - profile->frame_start;
+
+    memcpy(profile->history[profile->next], profile->current, sizeof(profile->current));
+    memset(profile->current, 0, sizeof(profile->current));
+    profile->next = (profile->next + 1) % LUMINO_PROFILE_FRAMES;
+    if (profile->count < LUMINO_PROFILE_FRAMES) profile->count++;
+    profile->frame_index++;
+    profile->frame_start = present_end;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+float lumino_profile_percentile(const LuminoRenderer* renderer, int stage, float pct) {
+    const lumino_profile* profile = renderer->profile;
+    if (!profile || profile->count == 0 || stage < 0 || stage >= LUMINO_STAGE_COUNT) {
+        return 0.0f;
+    }
+
+    uint64_t sorted[LUMINO_PROFILE_FRAMES];
+    for (int i = 0; i < profile->count; i++) {
+        sorted[i] = profile->history[i][stage];
+    }
+    qsort(sorted, profile->count, sizeof(uint64_t), compare_u64);
+
+    // nearest rank
+    int rank = (int)(pct / 100.0f * profile->count + 0.5f);
+    if (rank < 1) rank = 1;
+    if (rank > profile->count) rank = profile->count;
+    return sorted[rank - 1] / 1e6f;
+}
+
+int lumino_profile_write_csv(const LuminoRenderer* renderer, const char* path) {
+    const lumino_profile* profile = renderer->profile;
+    if (!profile) {
+        return LUMINO_FAILURE;
+    }
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return LUMINO_FAILURE;
+    }
+
+    fprintf(f, "frame");
+    for (int s = 0; s < LUMINO_STAGE_COUNT; s++) {
+        fprintf(f, ",%s_ms", stage_names[s]);
+    }
+    fprintf(f, "\n");
+
+    int oldest = (profile->next - profile->count + LUMINO_PROFILE_FRAMES) % LUMINO_PROFILE_FRAMES;
+    uint64_t first_index = profile->frame_index - profile->count;
+    for (int i = 0; i < profile->count; i++) {
+        const uint64_t* frame = profile->history[(oldest + i) % LUMINO_PROFILE_FRAMES];
+        fprintf(f, "%llu", (unsigned long long)(first_index + i));
+        for (int s = 0; s < LUMINO_STAGE_COUNT; s++) {
+            fprintf(f, ",%.3f", frame[s] / 1e6);
+        }
+        fprintf(f, "\n");
+    }
+
+    int result = ferror(f) ? LUMINO_FAILURE : LUMINO_SUCCESS;
+    fclose(f);
+    return result;
+}
+
+void lumino_profile_draw_overlay(LuminoRenderer* renderer) {
+    const lumino_profile* profile = renderer->profile;
+    if (!profile || renderer->index_buffer) {
+        return;
+    }
+    // the graph goes on top of everything recorded so far
+    lumino_flush(renderer);
+
+    int fbw = renderer->internal_width;
+    int fbh = renderer->internal_height;
+    int stride = renderer->stride;
+    uint32_t* fb = renderer->internal_framebuffer;
+    int max_height = fbh / 3;
+    int columns = profile->count < fbw ? profile->count : fbw;
+    lumino_mark_dirty(renderer, fbw - columns, fbh - max_height, columns, max_height);
+
+    // newest frame in the rightmost column
+    for (int c = 0; c < columns; c++) {
+        const uint64_t* frame = profile->history[(profile->next - 1 - c + LUMINO_PROFILE_FRAMES) % LUMINO_PROFILE_FRAMES];
+        int x = fbw - 1 - c;
+        int y = fbh - 1;
+        // stack the measured stages; the top of the stack is the frame time
+        for (int s = 0; s < LUMINO_STAGE_FRAME && y >= fbh - max_height; s++) {
+            int h = (int)(frame[s] / 1000000);
+            for (; h > 0 && y >= fbh - max_height; h--, y--) {
+                fb[y * stride + x] = stage_colors[s];
+            }
+        }
+    }
+
+    // 60 Hz budget line
+    int budget_y = fbh - 1 - 16;
+    if (budget_y >= fbh - max_height) {
+        for (int x = fbw - columns; x < fbw; x++) {
+            fb[budget_y * stride + x] = 0xFFFF0000;
+        }
+    }
+}
+
+const char* lumino_profile_stage_name(int stage) {
+    if (stage < 0 || stage >= LUMINO_STAGE_COUNT) return "unknown";
+    return stage_names[stage];
+}
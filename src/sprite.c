@@ -1,8 +1,11 @@
 #include "sprite.h"
 #include "primitives.h"
+#include "deferred.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <math.h>
+#include <string.h>
+#include "dispatch.h"
 #ifdef __ARM_NEON__
 #include <arm_neon.h>
 #endif
@@ -28,24 +31,21 @@ lumino_sprite lumino_load_png(LuminoRenderer* renderer, const char* filename) {
     }
 
     int pixelCount = sprite.width * sprite.height;
-    lumino_color* sprite_data = (lumino_color*)malloc(pixelCount * sizeof(lumino_color));
+    uint32_t* sprite_data = (uint32_t*)malloc(pixelCount * sizeof(uint32_t));
     if (!sprite_data) {
-        fprintf(stderr, "Out of memory allocating %zu bytes for sprite\n", pixelCount);
+        fprintf(stderr, "Out of memory allocating %zu bytes for sprite\n", pixelCount * sizeof(uint32_t));
         stbi_image_free(image);
         return sprite;
     }
 
-    // copy the pixel data from the image to the sprite data
-    for (size_t i = 0; i < pixelCount; ++i) {
-        // convert the RGBA pixel to an index in the palette
+    // swizzle once into the framebuffer's packed layout so blits never have to
+    for (int i = 0; i < pixelCount; ++i) {
         uint8_t r = image[i * 4 + 0]; // r
         uint8_t g = image[i * 4 + 1]; // g
         uint8_t b = image[i * 4 + 2]; // b
         uint8_t a = image[i * 4 + 3]; // a
 
-        // find the index in the palette
-        lumino_color color = {r, g, b, a};
-        sprite_data[i] = color;
+        sprite_data[i] = lumino_get_color((lumino_color){r, g, b, a});
     }
 
     
@@ -55,35 +55,113 @@ lumino_sprite lumino_load_png(LuminoRenderer* renderer, const char* filename) {
 
     // …and *now* attach it to the sprite struct
     sprite.data = sprite_data;
+
+    // precompiled skip/opaque/blend runs for lumino_draw_sprite_blend
+    // (optional, the per-pixel blitters are used if this fails)
+    sprite.runs = lumino_sprite_build_runs(&sprite);
+    return sprite;
+}
+
+// load_png_indexed
+lumino_sprite lumino_load_png_indexed(LuminoRenderer* renderer, const char* filename) {
+    int channels;
+    lumino_sprite sprite = {0};
+    unsigned char* image = stbi_load(filename,
+                                     &sprite.width,
+                                     &sprite.height,
+                                     &channels,
+                                     4 /* force RGBA */);
+    if (!image) {
+        fprintf(stderr, "Error loading image %s: %s\n",
+                filename,
+                stbi_failure_reason());
+        return sprite;  // sprite.index_data is already NULL
+    }
+
+    int pixelCount = sprite.width * sprite.height;
+    uint8_t* indices = (uint8_t*)malloc(pixelCount);
+    if (!indices) {
+        fprintf(stderr, "Out of memory allocating %d bytes for sprite\n", pixelCount);
+        stbi_image_free(image);
+        return sprite;
+    }
+
+    for (int i = 0; i < pixelCount; ++i) {
+        uint8_t r = image[i * 4 + 0];
+        uint8_t g = image[i * 4 + 1];
+        uint8_t b = image[i * 4 + 2];
+        uint8_t a = image[i * 4 + 3];
+
+        // fully transparent pixels all share the clear color
+        if (a == 0) {
+            indices[i] = 0;
+            continue;
+        }
+
+        int index = lumino_palette_find(renderer, r, g, b, a);
+        if (index < 0) {
+            if (renderer->palette_size < 256) {
+                index = renderer->palette_size;
+                lumino_add_palette_color(renderer, r, g, b, a);
+            } else {
+                index = lumino_palette_nearest(renderer, r, g, b, a);
+            }
+        }
+        indices[i] = (uint8_t)index;
+    }
+
+    stbi_image_free(image);
+
+    sprite.index_data = indices;
     return sprite;
 }
 
+void lumino_sprite_free(lumino_sprite* sprite) {
+    free(sprite->data);
+    free(sprite->index_data);
+    free(sprite->runs);
+    sprite->data = NULL;
+    sprite->index_data = NULL;
+    sprite->runs = NULL;
+}
+
 
 //-----------------------------------------------------------------------------
-// Sprite blit: scalar + NEON, copy vs. alpha-blend
+// Sprite blit: scalar + NEON + AVX2, copy vs. alpha-blend
 //-----------------------------------------------------------------------------
 
-// Scalar copy
+// Visible window of a sprite in sprite coordinates: columns [col0, col1) and
+// rows [row0, row1). Computed once per blit so the inner loops never test
+// bounds. Returns 0 when the sprite is entirely offscreen.
+typedef struct {
+    int col0, col1;
+    int row0, row1;
+} sprite_clip;
+
+static inline int sprite_clip_window(const lumino_sprite* sprite, int fbw, int fbh,
+                                     sprite_clip* clip)
+{
+    clip->col0 = sprite->x < 0 ? -sprite->x : 0;
+    clip->row0 = sprite->y < 0 ? -sprite->y : 0;
+    clip->col1 = sprite->x + sprite->width  > fbw ? fbw - sprite->x : sprite->width;
+    clip->row1 = sprite->y + sprite->height > fbh ? fbh - sprite->y : sprite->height;
+    return clip->col0 < clip->col1 && clip->row0 < clip->row1;
+}
+
+// Scalar copy: sprite rows are already in framebuffer layout
 static void lumino_draw_sprite_scalar(LuminoRenderer* R,
                                       lumino_sprite sprite)
 {
-    int x = sprite.x;
-    int y = sprite.y;
     uint32_t* fb    = R->internal_framebuffer;
-    int       fbw   = R->internal_width;
-    int       fb_h  = R->internal_height;
+    int       fbw   = R->stride;
     int       w     = sprite.width;
-    int       h     = sprite.height;
-    lumino_color* src = sprite.data;
+    sprite_clip clip;
+    if (!sprite_clip_window(&sprite, R->internal_width, R->internal_height, &clip)) return;
 
-    for (int row = 0; row < h; row++) {
-        int yy = y + row;
-        if ((unsigned)yy >= (unsigned)fb_h) continue;
-        for (int col = 0; col < w; col++) {
-            int xx = x + col;
-            if ((unsigned)xx >= (unsigned)fbw) continue;
-            fb[yy * fbw + xx] = lumino_get_color(src[row * w + col]);
-        }
+    size_t row_bytes = (clip.col1 - clip.col0) * sizeof(uint32_t);
+    for (int row = clip.row0; row < clip.row1; row++) {
+        memcpy(fb + (sprite.y + row) * fbw + sprite.x + clip.col0,
+               sprite.data + row * w + clip.col0, row_bytes);
     }
 }
 
@@ -91,157 +169,339 @@ static void lumino_draw_sprite_scalar(LuminoRenderer* R,
 void lumino_draw_sprite_scalar_blend(LuminoRenderer* R,
                                             lumino_sprite sprite)
 {
-    int x = sprite.x;
-    int y = sprite.y;
-    int       fbw   = R->internal_width;
-    int       fb_h  = R->internal_height;
+    uint32_t* fb    = R->internal_framebuffer;
+    int       fbw   = R->stride;
     int       w     = sprite.width;
-    int       h     = sprite.height;
-    lumino_color* src = sprite.data;
-
-    for (int row = 0; row < h; row++) {
-        int yy = y + row;
-        if ((unsigned)yy >= (unsigned)fb_h) continue;
-        for (int col = 0; col < w; col++) {
-            int xx = x + col;
-            if ((unsigned)xx >= (unsigned)fbw) continue;
-            lumino_draw_pixel_blend(R, xx, yy, src[row * w + col]);
+    sprite_clip clip;
+    if (!sprite_clip_window(&sprite, R->internal_width, R->internal_height, &clip)) return;
+
+    for (int row = clip.row0; row < clip.row1; row++) {
+        uint32_t* dst = fb + (sprite.y + row) * fbw + sprite.x;
+        const uint32_t* src = sprite.data + row * w;
+        for (int col = clip.col0; col < clip.col1; col++) {
+            dst[col] = lumino_blend_packed(dst[col], src[col]);
         }
     }
 }
 
+#ifdef __ARM_NEON__
 static void lumino_draw_sprite_neon(LuminoRenderer* R,
                                     lumino_sprite sprite)
 {
-    int x = sprite.x;
-    int y = sprite.y;
     uint32_t* fb    = R->internal_framebuffer;
-    int       fbw   = R->internal_width;
-    int       fb_h  = R->internal_height;
+    int       fbw   = R->stride;
     int       w     = sprite.width;
-    int       h     = sprite.height;
-    uint32_t* src   = (uint32_t*)sprite.data;
+    sprite_clip clip;
+    if (!sprite_clip_window(&sprite, R->internal_width, R->internal_height, &clip)) return;
+
+    for (int row = clip.row0; row < clip.row1; row++) {
+        uint32_t* dst = fb + (sprite.y + row) * fbw + sprite.x;
+        const uint32_t* srow = sprite.data + row * w;
+        int col = clip.col0;
+        // bulk copy, no channel swap needed any more
+        for (; col <= clip.col1 - 4; col += 4) {
+            vst1q_u32(dst + col, vld1q_u32(srow + col));
+        }
+        // tail pixels
+        for (; col < clip.col1; col++) {
+            dst[col] = srow[col];
+        }
+    }
+}
 
-    // Byte shuffle indices to swap R and B in each pixel: [2,1,0,3] per pixel
-    static const uint8_t shuffle_idx_data[16] = {
-        2, 1, 0, 3,  6, 5, 4, 7,
-       10, 9, 8,11, 14,13,12,15
-    };
-    const uint8x16_t shuffle_idx = vld1q_u8(shuffle_idx_data);
+// NEON blend of one span (8 pixels at a time) via vld4/vst4. Rounds with the
+// div255 of dispatch.h, so lanes and the scalar tail agree bit for bit.
+static void blend_span_neon(uint32_t* dst, const uint32_t* src, int count)
+{
+    uint8_t* dst_bytes = (uint8_t*)dst;
+    const uint8_t* src_bytes = (const uint8_t*)src;
+    const uint16x8_t k127 = vdupq_n_u16(127);
+
+    int col = 0;
+    for (; col <= count - 8; col += 8) {
+        // load 8 pixels de-interleaved; sprite and framebuffer share the
+        // packed layout, so val[0..3] are the same channel on both sides
+        uint8x8x4_t s = vld4_u8(src_bytes + col*4);
+
+        // the Sa == 0 and 255 shortcuts of lumino_blend_packed, per 8 pixels
+        uint64_t alphas = vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0);
+        if (alphas == 0) continue;
+        if (alphas == ~0ull) {
+            vst1q_u32(dst + col, vld1q_u32(src + col));
+            vst1q_u32(dst + col + 4, vld1q_u32(src + col + 4));
+            continue;
+        }
+        uint8x8x4_t d = vld4_u8(dst_bytes + col*4);
+
+        uint16x8_t sa = vmovl_u8(s.val[3]);
+        // inv_alpha = 255 - alpha
+        uint16x8_t ia = vsubq_u16(vdupq_n_u16(255), sa);
+
+        // out = (src*alpha + dst*inv_alpha + 127) / 255
+        uint8x8x4_t out;
+        for (int c = 0; c < 3; c++) {
+            uint16x8_t acc = vmlaq_u16(vmlaq_u16(k127, vmovl_u8(s.val[c]), sa),
+                                       vmovl_u8(d.val[c]), ia);
+            out.val[c] = vmovn_u16(lumino_div255_epu16_neon(acc));
+        }
+        // composite alpha: Aout = Sa + (Da*(255-Sa) + 127) / 255
+        out.val[3] = vmovn_u16(vaddq_u16(sa, lumino_div255_epu16_neon(vmlaq_u16(k127, vmovl_u8(d.val[3]), ia))));
 
-    for (int row = 0; row < h; row++) {
-        int yy = y + row;
-        if ((unsigned)yy >= (unsigned)fb_h) continue;
-        uint32_t* dst = fb + yy * fbw + x;
-        int col = 0;
-        // bulk copy with R/B swap
-        for (; col <= w - 4; col += 4) {
-            uint32x4_t pixels = vld1q_u32(src + row * w + col);
-            uint8x16_t bytes  = vreinterpretq_u8_u32(pixels);
-            uint8x16_t out    = vqtbl1q_u8(bytes, shuffle_idx);
-            vst1q_u32(dst + col, vreinterpretq_u32_u8(out));
+        // store 8 pixels
+        vst4_u8(dst_bytes + col*4, out);
+    }
+
+    // tail pixels: fall back to scalar
+    for (; col < count; col++) {
+        dst[col] = lumino_blend_packed(dst[col], src[col]);
+    }
+}
+#endif
+
+#if defined(LUMINO_X86)
+LUMINO_TARGET_AVX2
+static void lumino_draw_sprite_avx2(LuminoRenderer* R,
+                                    lumino_sprite sprite)
+{
+    uint32_t* fb    = R->internal_framebuffer;
+    int       fbw   = R->stride;
+    int       w     = sprite.width;
+    sprite_clip clip;
+    if (!sprite_clip_window(&sprite, R->internal_width, R->internal_height, &clip)) return;
+
+    for (int row = clip.row0; row < clip.row1; row++) {
+        uint32_t* dst = fb + (sprite.y + row) * fbw + sprite.x;
+        const uint32_t* srow = sprite.data + row * w;
+        int col = clip.col0;
+        // sprites are stored pre-swizzled, so this is a straight 8-pixel copy
+        for (; col <= clip.col1 - 8; col += 8) {
+            _mm256_storeu_si256((__m256i*)(dst + col),
+                                _mm256_loadu_si256((const __m256i*)(srow + col)));
         }
         // tail pixels
-        for (; col < w; col++) {
-            uint32_t p = src[row * w + col];
-            uint8_t* c = (uint8_t*)&p;
-            // assuming little-endian RGBA in memory: [B,G,R,A]
-            uint8_t b = c[0], g = c[1], r = c[2], a = c[3];
-            uint32_t swapped = (a << 24) | (b << 16) | (g << 8) | r;
-            // after swap: memory [R,G,B,A]
-            dst[col] = swapped;
+        for (; col < clip.col1; col++) {
+            dst[col] = srow[col];
         }
     }
 }
 
+// Blend 4 pixels widened to 16-bit lanes (2 per 128-bit lane). The alpha lane
+// uses 255 as its source factor, so it comes out as Sa + Da*(1-Sa) exactly
+// like lumino_blend_packed.
+LUMINO_TARGET_AVX2
+static inline __m256i blend_epu16_avx2(__m256i s, __m256i d)
+{
+    __m256i sa = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)),
+                                        _MM_SHUFFLE(3, 3, 3, 3));
+    __m256i k255 = _mm256_set1_epi16(255);
+    __m256i ia = _mm256_sub_epi16(k255, sa);
+    __m256i fa = _mm256_blend_epi16(sa, k255, 0x88);
+
+    __m256i acc = _mm256_add_epi16(_mm256_mullo_epi16(s, fa), _mm256_mullo_epi16(d, ia));
+    return lumino_div255_epu16_avx2(_mm256_add_epi16(acc, _mm256_set1_epi16(127)));
+}
+
+// AVX2 blend of one span, 8 pixels at a time. Bit-exact with the scalar path.
+LUMINO_TARGET_AVX2
+static void blend_span_avx2(uint32_t* dst, const uint32_t* src, int count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    int col = 0;
+    for (; col <= count - 8; col += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + col));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + col));
+
+        __m256i lo = blend_epu16_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+        __m256i hi = blend_epu16_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+
+        // unpack and pack both work per 128-bit lane, so pixel order is preserved
+        _mm256_storeu_si256((__m256i*)(dst + col), _mm256_packus_epi16(lo, hi));
+    }
+
+    // tail pixels: fall back to scalar
+    for (; col < count; col++) {
+        dst[col] = lumino_blend_packed(dst[col], src[col]);
+    }
+}
+#endif
+
 
-#ifdef __ARM_NEON__
-// NEON blend (4 pixels at a time) via vld4/vst4
-static void lumino_draw_sprite_neon_blend(LuminoRenderer* R,
+
+static void blend_span_scalar(uint32_t* dst, const uint32_t* src, int count)
+{
+    for (int i = 0; i < count; i++) {
+        dst[i] = lumino_blend_packed(dst[i], src[i]);
+    }
+}
+
+// Kernel table, scalar until lumino_dispatch_init picks SIMD variants
+static void blit_index_row_scalar(uint8_t* dst, const uint8_t* src, int count);
+
+// One enabled light, prepared for accumulation
+typedef struct {
+    float x, y;
+    float range_sq, inv_range_sq;
+    float b, g, r;                       // color * intensity, 0..1 per unit of intensity
+} light_params;
+
+static void light_span_scalar(float* acc, int plane, int x0, int count, float dy2, const light_params* l);
+static void lit_span_scalar(uint32_t* dst, const uint32_t* src, const uint16_t* light, int count);
+static void light_pack_scalar(uint16_t* dst, const float* acc, int plane, int count, float ambient);
+
+static struct {
+    void (*draw)(LuminoRenderer* R, lumino_sprite sprite);
+    void (*blend_span)(uint32_t* dst, const uint32_t* src, int count); // src-over of count packed pixels
+    void (*blit_index_row)(uint8_t* dst, const uint8_t* src, int count);
+    // add one light's falloff to the B, G and R planes (plane floats apart) of columns [x0, x0 + count)
+    void (*light_span)(float* acc, int plane, int x0, int count, float dy2, const light_params* l);
+    void (*lit_span)(uint32_t* dst, const uint32_t* src, const uint16_t* light, int count); // src times lightmap
+    void (*light_pack)(uint16_t* dst, const float* acc, int plane, int count, float ambient); // ambient + planes -> 8.8 B, G, R, A
+} kernels = {
+    lumino_draw_sprite_scalar,
+    blend_span_scalar,
+    blit_index_row_scalar,
+    light_span_scalar,
+    lit_span_scalar,
+    light_pack_scalar,
+};
+
+// Alpha-blend every visible row with the selected span kernel
+static void lumino_draw_sprite_span_blend(LuminoRenderer* R,
                                           lumino_sprite sprite)
-{   
-    int x = sprite.x;
-    int y = sprite.y;
-    uint8_t* fb_bytes = (uint8_t*)R->internal_framebuffer;
-    int fbw = R->internal_width;
-    int fbh = R->internal_height;
+{
+    uint32_t* fb = R->internal_framebuffer;
+    int fbw = R->stride;
     int w   = sprite.width;
-    int h   = sprite.height;
-    uint8_t* src_bytes = (uint8_t*)sprite.data;
+    sprite_clip clip;
+    if (!sprite_clip_window(&sprite, R->internal_width, R->internal_height, &clip)) return;
 
-    for (int row = 0; row < h; row++) {
-        int yy = y + row;
-        if ((unsigned)yy >= (unsigned)fbh) continue;
+    for (int row = clip.row0; row < clip.row1; row++) {
+        kernels.blend_span(fb + (sprite.y + row) * fbw + sprite.x + clip.col0,
+                           sprite.data + row * w + clip.col0, clip.col1 - clip.col0);
+    }
+}
 
-        uint8_t* dst_row = fb_bytes + (yy * fbw + x) * 4;
-        uint8_t* src_row = src_bytes + (row * w) * 4;
 
-        int col = 0;
-        for (; col <= w - 8; col += 8) {
-            // load 8 pixels de-interleaved: R,G,B,A each into val[0..3]
-            uint8x8x4_t s = vld4_u8(src_row + col*4);
-            uint8x8x4_t d = vld4_u8(dst_row + col*4);
-
-            // widen to 16-bit
-            uint16x8_t sr = vmovl_u8(s.val[2]);
-            uint16x8_t sg = vmovl_u8(s.val[1]);
-            uint16x8_t sb = vmovl_u8(s.val[0]);
-            uint16x8_t sa = vmovl_u8(s.val[3]);
-
-            uint16x8_t dr = vmovl_u8(d.val[0]);
-            uint16x8_t dg = vmovl_u8(d.val[1]);
-            uint16x8_t db = vmovl_u8(d.val[2]);
-
-            // inv_alpha = 255 - alpha
-            uint16x8_t ia = vsubq_u16(vdupq_n_u16(255), sa);
-
-            // out = (src*alpha + dst*inv_alpha + 127) / 255
-            uint16x8_t rr = vrshrq_n_u16(vmlaq_u16(vmulq_u16(sr, sa),
-                                                   dr, ia),
-                                         8);
-            uint16x8_t gg = vrshrq_n_u16(vmlaq_u16(vmulq_u16(sg, sa),
-                                                   dg, ia),
-                                         8);
-            uint16x8_t bb = vrshrq_n_u16(vmlaq_u16(vmulq_u16(sb, sa),
-                                                   db, ia),
-                                         8);
-
-            // narrow back to 8-bit
-            uint8x8x4_t out;
-            out.val[0] = vmovn_u16(rr);
-            out.val[1] = vmovn_u16(gg);
-            out.val[2] = vmovn_u16(bb);
-            out.val[3] = vmovn_u16(sa);  // keep source alpha in dest
-
-            // store 8 pixels
-            vst4_u8(dst_row + col*4, out);
+//-----------------------------------------------------------------------------
+// Run-length encoded rows: skip / opaque copy / translucent blend
+//-----------------------------------------------------------------------------
+
+// classify a pixel by its alpha
+static inline int run_kind(uint32_t pixel) {
+    uint32_t a = pixel >> 24;
+    return a == 0 ? LUMINO_RUN_SKIP : (a == 255 ? LUMINO_RUN_OPAQUE : LUMINO_RUN_BLEND);
+}
+
+lumino_sprite_runs* lumino_sprite_build_runs(const lumino_sprite* sprite) {
+    int w = sprite->width;
+    int h = sprite->height;
+    if (!sprite->data || w <= 0 || h <= 0) return NULL;
+
+    // count first so the whole thing is one allocation
+    int run_count = 0;
+    for (int row = 0; row < h; row++) {
+        const uint32_t* src = sprite->data + row * w;
+        for (int col = 0; col < w; ) {
+            int kind = run_kind(src[col]);
+            int len = 1;
+            while (col + len < w && len < UINT16_MAX && run_kind(src[col + len]) == kind) len++;
+            col += len;
+            run_count++;
         }
+    }
 
-        // tail pixels: fall back to scalar
-        for (; col < w; col++) {
-            lumino_draw_pixel_blend(R, x + col, yy, sprite.data[row * w + col]);
+    size_t bytes = sizeof(lumino_sprite_runs)
+                 + (size_t)(h + 1) * sizeof(int)
+                 + (size_t)run_count * sizeof(lumino_sprite_run);
+    lumino_sprite_runs* runs = (lumino_sprite_runs*)malloc(bytes);
+    if (!runs) return NULL;
+    runs->row_start = (int*)(runs + 1);
+    runs->runs = (lumino_sprite_run*)(runs->row_start + h + 1);
+    runs->run_count = run_count;
+
+    int n = 0;
+    for (int row = 0; row < h; row++) {
+        const uint32_t* src = sprite->data + row * w;
+        runs->row_start[row] = n;
+        for (int col = 0; col < w; ) {
+            int kind = run_kind(src[col]);
+            int len = 1;
+            while (col + len < w && len < UINT16_MAX && run_kind(src[col + len]) == kind) len++;
+            runs->runs[n].kind = (uint16_t)kind;
+            runs->runs[n].length = (uint16_t)len;
+            n++;
+            col += len;
         }
     }
+    runs->row_start[h] = n;
+    return runs;
 }
-#endif
 
+// Opaque runs are memcpy'd, translucent runs blended, skip runs cost nothing
+static void lumino_draw_sprite_rle(LuminoRenderer* R, lumino_sprite sprite)
+{
+    uint32_t* fb = R->internal_framebuffer;
+    int fbw = R->stride;
+    int w   = sprite.width;
+    const lumino_sprite_runs* runs = sprite.runs;
+    sprite_clip clip;
+    if (!sprite_clip_window(&sprite, R->internal_width, R->internal_height, &clip)) return;
+    int col0 = clip.col0;
+    int col1 = clip.col1;
+
+    for (int row = clip.row0; row < clip.row1; row++) {
+        const uint32_t* src = sprite.data + row * w;
+        uint32_t* dst = fb + (sprite.y + row) * fbw + sprite.x;
+        int col = 0;
+        for (int r = runs->row_start[row]; r < runs->row_start[row + 1] && col < col1; r++) {
+            int start = col;
+            int end = col + runs->runs[r].length;
+            col = end;
+            if (runs->runs[r].kind == LUMINO_RUN_SKIP) continue;
+
+            // clip the run against the visible columns
+            if (start < col0) start = col0;
+            if (end > col1) end = col1;
+            if (start >= end) continue;
+
+            if (runs->runs[r].kind == LUMINO_RUN_OPAQUE) {
+                memcpy(dst + start, src + start, (end - start) * sizeof(uint32_t));
+            } else {
+                kernels.blend_span(dst + start, src + start, end - start);
+            }
+        }
+    }
+}
 
+// In deferred mode record the blit and return 1 (deferred.h). The sprite is
+// copied by value, its pixels must stay alive until the next flush.
+static inline int defer_sprite(LuminoRenderer* R, int op, const lumino_sprite* sprite,
+                               const lumino_light* light, float ambient) {
+    if (!R->deferred) return 0;
+    lumino_command* c = lumino_defer(R, op);
+    if (!c) return 0;
+    c->sprite.sprite = *sprite;
+    if (light) c->sprite.light = *light;
+    c->sprite.ambient = ambient;
+    return 1;
+}
 
 void lumino_draw_sprite(LuminoRenderer* renderer, lumino_sprite sprite) {
-#if defined(__ARM_NEON__)
-    lumino_draw_sprite_neon(renderer, sprite);
-#else
-    lumino_draw_sprite_scalar(renderer, x, y, sprite);
-#endif
+    lumino_mark_dirty(renderer, sprite.x, sprite.y, sprite.width, sprite.height);
+    if (defer_sprite(renderer, LUMINO_CMD_SPRITE, &sprite, NULL, 0.0f)) return;
+    kernels.draw(renderer, sprite);
 }
 
-// Important Note: This function is not optimized for NEON yet so only use blend when needed
+// Blending costs more than a copy, so only use blend when needed
 void lumino_draw_sprite_blend(LuminoRenderer* renderer, lumino_sprite sprite) {
-#if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
-    lumino_draw_sprite_neon_blend(renderer, sprite);
-#else
-    lumino_draw_sprite_scalar_blend(renderer, x, y, sprite);
-#endif
+    lumino_mark_dirty(renderer, sprite.x, sprite.y, sprite.width, sprite.height);
+    if (defer_sprite(renderer, LUMINO_CMD_SPRITE_BLEND, &sprite, NULL, 0.0f)) return;
+    if (sprite.runs) {
+        lumino_draw_sprite_rle(renderer, sprite);
+        return;
+    }
+    lumino_draw_sprite_span_blend(renderer, sprite);
 }
 
 
@@ -252,12 +512,11 @@ void lumino_draw_sprite_lit(LuminoRenderer* R,
                              lumino_light light,
                              float ambient)
 {
-    int fbw = R->internal_width;
+    int fbw = R->stride;
     int fbh = R->internal_height;
     uint32_t* fb = R->internal_framebuffer;
     int w = sprite.width;
-    int h = sprite.height;
-    uint32_t* src = sprite.data;
+    const uint32_t* src = sprite.data;
 
     // Precompute squared range and its inverse
     float range_sq    = light.range * light.range;
@@ -268,20 +527,23 @@ void lumino_draw_sprite_lit(LuminoRenderer* R,
     float light_g = light.color.g / 255.0f;
     float light_b = light.color.b / 255.0f;
 
-    for (int row = 0; row < h; row++) {
+    sprite_clip clip;
+    if (!sprite_clip_window(&sprite, R->internal_width, fbh, &clip)) return;
+    lumino_mark_dirty(R, sprite.x, sprite.y, sprite.width, sprite.height);
+    if (defer_sprite(R, LUMINO_CMD_SPRITE_LIT, &sprite, &light, ambient)) return;
+
+    for (int row = clip.row0; row < clip.row1; row++) {
         int yy = sprite.y + row;
-        if ((unsigned)yy >= (unsigned)fbh) continue;
 
-        for (int col = 0; col < w; col++) {
+        for (int col = clip.col0; col < clip.col1; col++) {
             int xx = sprite.x + col;
-            if ((unsigned)xx >= (unsigned)fbw) continue;
 
             int idx = row * w + col;
             uint32_t c_src = src[idx];
             lumino_color c = {
-                .r = (c_src      ) & 0xFF,
+                .r = (c_src >> 16) & 0xFF,
                 .g = (c_src >>  8) & 0xFF,
-                .b = (c_src >> 16) & 0xFF,
+                .b = (c_src      ) & 0xFF,
                 .a = (c_src >> 24) & 0xFF
             };
             if (c.a == 0) continue;
@@ -324,3 +586,407 @@ void lumino_draw_sprite_lit(LuminoRenderer* R,
         }
     }
 }
+
+
+//-----------------------------------------------------------------------------
+// Lightmap: lights accumulated once per change, blits multiply against it
+//-----------------------------------------------------------------------------
+
+// Falloff of lumino_draw_sprite_lit, max(0, 1 - d^2 / range^2), times the
+// light's color. dx is computed from the integer column at every level, so
+// all levels accumulate bit-identical lightmaps.
+static void light_span_scalar(float* acc, int plane, int x0, int count, float dy2, const light_params* l) {
+    for (int i = x0; i < x0 + count; i++) {
+        float dx = (float)i - l->x;
+        float a = 1.0f - (dx * dx + dy2) * l->inv_range_sq;
+        if (a <= 0.0f) continue;
+        acc[i] += a * l->b;
+        acc[plane + i] += a * l->g;
+        acc[2 * plane + i] += a * l->r;
+    }
+}
+
+// Channels times their 8.8 factor, saturated; alpha is kept and transparent
+// source pixels leave the destination alone
+static void lit_span_scalar(uint32_t* dst, const uint32_t* src, const uint16_t* light, int count) {
+    for (int i = 0; i < count; i++) {
+        uint32_t s = src[i];
+        if (!(s >> 24)) continue;
+        const uint16_t* f = light + i * 4;
+        uint32_t b = ((s & 0xFF) * f[0]) >> 8;
+        uint32_t g = (((s >> 8) & 0xFF) * f[1]) >> 8;
+        uint32_t r = (((s >> 16) & 0xFF) * f[2]) >> 8;
+        dst[i] = (s & 0xFF000000) | (r > 255 ? 255 : r) << 16 | (g > 255 ? 255 : g) << 8 | (b > 255 ? 255 : b);
+    }
+}
+
+// Ambient plus the accumulated lights to 8.8 fixed point, rounded and kept
+// below 128.0 so lit_span's products fit the 16-bit lanes (NaN becomes 0);
+// alpha gets 1.0
+static void light_pack_scalar(uint16_t* dst, const float* acc, int plane, int count, float ambient) {
+    for (int i = 0; i < count; i++) {
+        for (int c = 0; c < 3; c++) {
+            float v = (acc[c * plane + i] + ambient) * 256.0f + 0.5f;
+            v = v > 0.0f ? v : 0.0f;
+            v = v < 32767.0f ? v : 32767.0f;
+            dst[i * 4 + c] = (uint16_t)v;
+        }
+        dst[i * 4 + 3] = 256;
+    }
+}
+
+#if defined(LUMINO_X86)
+LUMINO_TARGET_SSE2
+static void light_span_sse2(float* acc, int plane, int x0, int count, float dy2, const light_params* l) {
+    const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+    const __m128 vdy2 = _mm_set1_ps(dy2), inv = _mm_set1_ps(l->inv_range_sq), lx = _mm_set1_ps(l->x);
+    const __m128 cb = _mm_set1_ps(l->b), cg = _mm_set1_ps(l->g), cr = _mm_set1_ps(l->r);
+    int i = x0;
+    for (; i <= x0 + count - 4; i += 4) {
+        __m128 dx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(i), _mm_setr_epi32(0, 1, 2, 3))), lx);
+        __m128 a = _mm_max_ps(zero, _mm_sub_ps(one, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(dx, dx), vdy2), inv)));
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(a, cb)));
+        _mm_storeu_ps(acc + plane + i, _mm_add_ps(_mm_loadu_ps(acc + plane + i), _mm_mul_ps(a, cg)));
+        _mm_storeu_ps(acc + 2 * plane + i, _mm_add_ps(_mm_loadu_ps(acc + 2 * plane + i), _mm_mul_ps(a, cr)));
+    }
+    light_span_scalar(acc, plane, i, x0 + count - i, dy2, l);
+}
+
+// 4 pixels: bytes widened into the high half of 16-bit lanes, so mulhi gives
+// (channel * factor) >> 8; factors stay below 128.0, which keeps the result
+// in range for the saturating pack
+LUMINO_TARGET_SSE2
+static void lit_span_sse2(uint32_t* dst, const uint32_t* src, const uint16_t* light, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    int i = 0;
+    for (; i <= count - 4; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(zero, s), _mm_loadu_si128((const __m128i*)(light + i * 4)));
+        __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(zero, s), _mm_loadu_si128((const __m128i*)(light + i * 4 + 8)));
+        __m128i lit = _mm_packus_epi16(lo, hi);
+        __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(s, alpha), zero);
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, lit)));
+    }
+    lit_span_scalar(dst + i, src + i, light + i * 4, count - i);
+}
+
+// 4 pixels: one plane per register, interleaved by two rounds of unpacks.
+// Store-bound, so AVX2 uses it as well.
+LUMINO_TARGET_SSE2
+static void light_pack_sse2(uint16_t* dst, const float* acc, int plane, int count, float ambient) {
+    const __m128 amb = _mm_set1_ps(ambient), scale = _mm_set1_ps(256.0f), half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps(), top = _mm_set1_ps(32767.0f);
+    const __m128i alpha = _mm_set1_epi16(256);
+    int i = 0;
+    for (; i <= count - 4; i += 4) {
+        __m128i c[3];
+        for (int k = 0; k < 3; k++) {
+            __m128 v = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(acc + k * plane + i), amb), scale), half);
+            // max with v first: NaN comes out as 0
+            v = _mm_min_ps(_mm_max_ps(v, zero), top);
+            __m128i n = _mm_cvttps_epi32(v);
+            c[k] = _mm_packs_epi32(n, n);
+        }
+        __m128i bg = _mm_unpacklo_epi16(c[0], c[1]);
+        __m128i ra = _mm_unpacklo_epi16(c[2], alpha);
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_unpacklo_epi32(bg, ra));
+        _mm_storeu_si128((__m128i*)(dst + i * 4 + 8), _mm_unpackhi_epi32(bg, ra));
+    }
+    light_pack_scalar(dst + i * 4, acc + i, plane, count - i, ambient);
+}
+
+LUMINO_TARGET_AVX2
+static void light_span_avx2(float* acc, int plane, int x0, int count, float dy2, const light_params* l) {
+    const __m256 one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+    const __m256 vdy2 = _mm256_set1_ps(dy2), inv = _mm256_set1_ps(l->inv_range_sq), lx = _mm256_set1_ps(l->x);
+    const __m256 cb = _mm256_set1_ps(l->b), cg = _mm256_set1_ps(l->g), cr = _mm256_set1_ps(l->r);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int i = x0;
+    for (; i <= x0 + count - 8; i += 8) {
+        __m256 dx = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(i), lanes)), lx);
+        __m256 a = _mm256_max_ps(zero, _mm256_sub_ps(one, _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), vdy2), inv)));
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(a, cb)));
+        _mm256_storeu_ps(acc + plane + i, _mm256_add_ps(_mm256_loadu_ps(acc + plane + i), _mm256_mul_ps(a, cg)));
+        _mm256_storeu_ps(acc + 2 * plane + i, _mm256_add_ps(_mm256_loadu_ps(acc + 2 * plane + i), _mm256_mul_ps(a, cr)));
+    }
+    light_span_scalar(acc, plane, i, x0 + count - i, dy2, l);
+}
+
+// 8 pixels; unpack works per 128-bit lane (pixels 0-1 and 4-5 in lo), so the
+// factors are regrouped the same way
+LUMINO_TARGET_AVX2
+static void lit_span_avx2(uint32_t* dst, const uint32_t* src, const uint16_t* light, int count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+    int i = 0;
+    for (; i <= count - 8; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i l0 = _mm256_loadu_si256((const __m256i*)(light + i * 4));
+        __m256i l1 = _mm256_loadu_si256((const __m256i*)(light + i * 4 + 16));
+        __m256i lo = _mm256_mulhi_epu16(_mm256_unpacklo_epi8(zero, s), _mm256_permute2x128_si256(l0, l1, 0x20));
+        __m256i hi = _mm256_mulhi_epu16(_mm256_unpackhi_epi8(zero, s), _mm256_permute2x128_si256(l0, l1, 0x31));
+        __m256i lit = _mm256_packus_epi16(lo, hi);
+        __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha), zero);
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(lit, d, keep));
+    }
+    lit_span_scalar(dst + i, src + i, light + i * 4, count - i);
+}
+#endif
+
+#ifdef __ARM_NEON__
+static void light_span_neon(float* acc, int plane, int x0, int count, float dy2, const light_params* l) {
+    const float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f);
+    const float32x4_t vdy2 = vdupq_n_f32(dy2), inv = vdupq_n_f32(l->inv_range_sq), lx = vdupq_n_f32(l->x);
+    const int32_t lane_init[4] = { 0, 1, 2, 3 };
+    const int32x4_t lanes = vld1q_s32(lane_init);
+    int i = x0;
+    for (; i <= x0 + count - 4; i += 4) {
+        float32x4_t dx = vsubq_f32(vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(i), lanes)), lx);
+        // separate multiply and add (no vmla), rounding like the scalar path
+        float32x4_t a = vmaxq_f32(zero, vsubq_f32(one, vmulq_f32(vaddq_f32(vmulq_f32(dx, dx), vdy2), inv)));
+        vst1q_f32(acc + i, vaddq_f32(vld1q_f32(acc + i), vmulq_n_f32(a, l->b)));
+        vst1q_f32(acc + plane + i, vaddq_f32(vld1q_f32(acc + plane + i), vmulq_n_f32(a, l->g)));
+        vst1q_f32(acc + 2 * plane + i, vaddq_f32(vld1q_f32(acc + 2 * plane + i), vmulq_n_f32(a, l->r)));
+    }
+    light_span_scalar(acc, plane, i, x0 + count - i, dy2, l);
+}
+
+// 4 pixels, vst4 does the interleave
+static void light_pack_neon(uint16_t* dst, const float* acc, int plane, int count, float ambient) {
+    const float32x4_t amb = vdupq_n_f32(ambient), zero = vdupq_n_f32(0.0f), top = vdupq_n_f32(32767.0f), half = vdupq_n_f32(0.5f);
+    int i = 0;
+    for (; i <= count - 4; i += 4) {
+        uint16x4x4_t out;
+        for (int k = 0; k < 3; k++) {
+            float32x4_t v = vaddq_f32(vmulq_n_f32(vaddq_f32(vld1q_f32(acc + k * plane + i), amb), 256.0f), half);
+            // NaN survives the clamp, the conversion turns it into 0
+            v = vminq_f32(vmaxq_f32(v, zero), top);
+            out.val[k] = vmovn_u32(vcvtq_u32_f32(v));
+        }
+        out.val[3] = vdup_n_u16(256);
+        vst4_u16(dst + i * 4, out);
+    }
+    light_pack_scalar(dst + i * 4, acc + i, plane, count - i, ambient);
+}
+
+// 4 pixels, 32-bit products narrowed back by >> 8 (at most 255 * 32767 >> 8)
+static void lit_span_neon(uint32_t* dst, const uint32_t* src, const uint16_t* light, int count) {
+    int i = 0;
+    for (; i <= count - 4; i += 4) {
+        uint8x16_t s = vld1q_u8((const uint8_t*)(src + i));
+        uint16x8_t lo = vmovl_u8(vget_low_u8(s));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(s));
+        uint16x8_t l0 = vld1q_u16(light + i * 4);
+        uint16x8_t l1 = vld1q_u16(light + i * 4 + 8);
+        uint16x8_t plo = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(lo), vget_low_u16(l0)), 8),
+                                      vshrn_n_u32(vmull_u16(vget_high_u16(lo), vget_high_u16(l0)), 8));
+        uint16x8_t phi = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(hi), vget_low_u16(l1)), 8),
+                                      vshrn_n_u32(vmull_u16(vget_high_u16(hi), vget_high_u16(l1)), 8));
+        uint32x4_t lit = vreinterpretq_u32_u8(vcombine_u8(vqmovn_u16(plo), vqmovn_u16(phi)));
+        uint32x4_t keep = vceqq_u32(vandq_u32(vreinterpretq_u32_u8(s), vdupq_n_u32(0xFF000000)), vdupq_n_u32(0));
+        vst1q_u32(dst + i, vbslq_u32(keep, vld1q_u32(dst + i), lit));
+    }
+    lit_span_scalar(dst + i, src + i, light + i * 4, count - i);
+}
+#endif
+
+// Accumulate ambient plus every enabled light, row by row, touching only the
+// columns each light reaches. Returns 0 when out of memory.
+static int lightmap_build(LuminoRenderer* R) {
+    int w = R->internal_width;
+    int h = R->internal_height;
+    int stride = R->stride;
+    size_t map_size = (size_t)stride * h * 4 * sizeof(uint16_t);
+    if (!R->lightmap) {
+        // the float row accumulator lives right after the map, so rebuilding
+        // any number of times between presents allocates nothing
+        R->lightmap = (uint16_t*)lumino_persistent_alloc(R, map_size + 3 * (size_t)stride * sizeof(float));
+        if (!R->lightmap) return 0;
+    }
+    float* acc = (float*)((uint8_t*)R->lightmap + map_size);
+
+    float ambient = R->light_ambient;
+    light_params lights[LUMINO_MAX_LIGHTS];
+    int count = 0;
+    for (int i = 0; i < R->light_count; i++) {
+        const lumino_light* light = &R->lights[i];
+        if (!light->enabled || !(light->range > 0.0f)) continue;
+        light_params* l = &lights[count++];
+        l->x = light->x;
+        l->y = light->y;
+        l->range_sq = light->range * light->range;
+        l->inv_range_sq = 1.0f / l->range_sq;
+        l->b = light->color.b / 255.0f * light->intensity;
+        l->g = light->color.g / 255.0f * light->intensity;
+        l->r = light->color.r / 255.0f * light->intensity;
+    }
+
+    for (int y = 0; y < h; y++) {
+        memset(acc, 0, 3 * (size_t)stride * sizeof(float));
+        for (int i = 0; i < count; i++) {
+            const light_params* l = &lights[i];
+            float dy = (float)y - l->y;
+            float dy2 = dy * dy;
+            if (dy2 >= l->range_sq) continue;
+            // chord of the light's circle on this row, clipped in float first
+            float half = sqrtf(l->range_sq - dy2);
+            float left = floorf(l->x - half);
+            float right = ceilf(l->x + half) + 1.0f;
+            int x0 = left < 0.0f ? 0 : (left > (float)w ? w : (int)left);
+            int x1 = right < 0.0f ? 0 : (right > (float)w ? w : (int)right);
+            if (x0 < x1) {
+                kernels.light_span(acc, stride, x0, x1 - x0, dy2, l);
+            }
+        }
+
+        kernels.light_pack(R->lightmap + (size_t)y * stride * 4, acc, stride, w, ambient);
+    }
+    R->lightmap_stale = 0;
+    return 1;
+}
+
+int lumino_set_lights(LuminoRenderer* R, const lumino_light* lights, int count, float ambient) {
+    int result = LUMINO_SUCCESS;
+    if (count > LUMINO_MAX_LIGHTS) {
+        count = LUMINO_MAX_LIGHTS;
+        result = LUMINO_FAILURE;
+    }
+    if (count < 0) count = 0;
+
+    // same lights as before: the lightmap is still good
+    if (count == R->light_count && ambient == R->light_ambient &&
+        (count == 0 || memcmp(R->lights, lights, count * sizeof(lumino_light)) == 0)) {
+        return result;
+    }
+    // recorded draws replay against the lightmap they were recorded with
+    lumino_flush(R);
+    if (count > 0) {
+        memcpy(R->lights, lights, count * sizeof(lumino_light));
+    }
+    R->light_count = count;
+    R->light_ambient = ambient;
+    R->lightmap_stale = 1;
+    return result;
+}
+
+void lumino_draw_sprite_lightmap(LuminoRenderer* R, lumino_sprite sprite) {
+    sprite_clip clip;
+    if (!sprite_clip_window(&sprite, R->internal_width, R->internal_height, &clip)) return;
+    // built here rather than at flush, so tiles only ever read it
+    if (R->lightmap_stale && !lightmap_build(R)) return;
+    lumino_mark_dirty(R, sprite.x, sprite.y, sprite.width, sprite.height);
+    if (defer_sprite(R, LUMINO_CMD_SPRITE_LIGHTMAP, &sprite, NULL, 0.0f)) return;
+
+    int fbw = R->stride;
+    for (int row = clip.row0; row < clip.row1; row++) {
+        size_t offset = (size_t)(sprite.y + row) * fbw + sprite.x + clip.col0;
+        kernels.lit_span(R->internal_framebuffer + offset, sprite.data + row * sprite.width + clip.col0,
+                         R->lightmap + offset * 4, clip.col1 - clip.col0);
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+// Indexed sprite blit: copy indices, index 0 is transparent
+//-----------------------------------------------------------------------------
+
+static void blit_index_row_scalar(uint8_t* dst, const uint8_t* src, int count) {
+    for (int i = 0; i < count; i++) {
+        uint8_t c = src[i];
+        if (c) dst[i] = c;
+    }
+}
+
+#if defined(__ARM_NEON__)
+static void blit_index_row_neon(uint8_t* dst, const uint8_t* src, int count) {
+    int i = 0;
+    for (; i <= count - 16; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t d = vld1q_u8(dst + i);
+        // keep dst where the sprite index is 0
+        uint8x16_t clear = vceqq_u8(s, vdupq_n_u8(0));
+        vst1q_u8(dst + i, vbslq_u8(clear, d, s));
+    }
+    blit_index_row_scalar(dst + i, src + i, count - i);
+}
+#endif
+
+#if defined(LUMINO_X86)
+LUMINO_TARGET_AVX2
+static void blit_index_row_avx2(uint8_t* dst, const uint8_t* src, int count) {
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i <= count - 32; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        // keep dst where the sprite index is 0
+        __m256i clear = _mm256_cmpeq_epi8(s, zero);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(s, d, clear));
+    }
+    blit_index_row_scalar(dst + i, src + i, count - i);
+}
+#endif
+
+void lumino_draw_sprite_index(LuminoRenderer* R, lumino_sprite sprite) {
+    int fbw = R->stride;
+    sprite_clip clip;
+    if (!sprite_clip_window(&sprite, R->internal_width, R->internal_height, &clip)) return;
+    lumino_mark_dirty(R, sprite.x, sprite.y, sprite.width, sprite.height);
+    if (defer_sprite(R, LUMINO_CMD_SPRITE_INDEX, &sprite, NULL, 0.0f)) return;
+    int col0 = clip.col0;
+    int col1 = clip.col1;
+
+    for (int row = clip.row0; row < clip.row1; row++) {
+        uint8_t* dst = R->index_buffer + (sprite.y + row) * fbw + sprite.x + col0;
+        const uint8_t* src = sprite.index_data + row * sprite.width + col0;
+        kernels.blit_index_row(dst, src, col1 - col0);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Kernel selection
+//-----------------------------------------------------------------------------
+
+void lumino_sprite_select_kernels(int level) {
+    kernels.draw           = lumino_draw_sprite_scalar;
+    kernels.blend_span     = blend_span_scalar;
+    kernels.blit_index_row = blit_index_row_scalar;
+    kernels.light_span     = light_span_scalar;
+    kernels.lit_span       = lit_span_scalar;
+    kernels.light_pack     = light_pack_scalar;
+
+    switch (level) {
+#if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
+        case LUMINO_SIMD_NEON:
+            kernels.draw           = lumino_draw_sprite_neon;
+            kernels.blend_span     = blend_span_neon;
+            kernels.blit_index_row = blit_index_row_neon;
+            kernels.light_span     = light_span_neon;
+            kernels.lit_span       = lit_span_neon;
+            kernels.light_pack     = light_pack_neon;
+            break;
+#endif
+#if defined(LUMINO_X86)
+        case LUMINO_SIMD_AVX2:
+            kernels.draw           = lumino_draw_sprite_avx2;
+            kernels.blend_span     = blend_span_avx2;
+            kernels.blit_index_row = blit_index_row_avx2;
+            kernels.light_span     = light_span_avx2;
+            kernels.lit_span       = lit_span_avx2;
+            kernels.light_pack     = light_pack_sse2;
+            break;
+        case LUMINO_SIMD_SSE2:
+            // only the lightmap kernels: rows are memcpy'd and the blend
+            // needs 16-bit multiplies per channel that only pay off at AVX2 width
+            kernels.light_span     = light_span_sse2;
+            kernels.lit_span       = lit_span_sse2;
+            kernels.light_pack     = light_pack_sse2;
+            break;
+#endif
+        default:
+            break;
+    }
+}
@@ -0,0 +1,136 @@
+// threadpool.c - fixed-size SDL worker pool used for band/tile parallel work
+
+#include "threadpool.h"
+#include <stdlib.h>
+
+struct lumino_thread_pool {
+    SDL_Thread** workers;
+    int worker_count;           // spawned threads, excluding the caller
+
+    SDL_mutex* lock;
+    SDL_cond* work_ready;       // signalled when a new batch is published
+    SDL_cond* work_done;        // signalled when the last worker finishes a batch
+    int generation;             // bumped once per batch
+    int busy_workers;           // workers still draining the current batch
+    int quit;
+
+    // current batch
+    lumino_job_fn fn;
+    void* ctx;
+    int job_count;
+    SDL_atomic_t next_job;
+};
+
+// grab job indices until the batch is exhausted
+static void pool_drain(lumino_thread_pool* pool) {
+    int i;
+    while ((i = SDL_AtomicAdd(&pool->next_job, 1)) < pool->job_count) {
+        pool->fn(pool->ctx, i);
+    }
+}
+
+static int pool_worker(void* data) {
+    lumino_thread_pool* pool = (lumino_thread_pool*)data;
+    int seen = 0;
+
+    SDL_LockMutex(pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen) {
+            SDL_CondWait(pool->work_ready, pool->lock);
+        }
+        if (pool->quit) break;
+        seen = pool->generation;
+        SDL_UnlockMutex(pool->lock);
+
+        pool_drain(pool);
+
+        SDL_LockMutex(pool->lock);
+        if (--pool->busy_workers == 0) {
+            SDL_CondSignal(pool->work_done);
+        }
+    }
+    SDL_UnlockMutex(pool->lock);
+    return 0;
+}
+
+lumino_thread_pool* lumino_pool_create(int thread_count) {
+    if (thread_count <= 1) {
+        return NULL;  // single-threaded, run inline
+    }
+
+    lumino_thread_pool* pool = (lumino_thread_pool*)calloc(1, sizeof(lumino_thread_pool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->workers = (SDL_Thread**)calloc(thread_count - 1, sizeof(SDL_Thread*));
+    pool->lock = SDL_CreateMutex();
+    pool->work_ready = SDL_CreateCond();
+    pool->work_done = SDL_CreateCond();
+    if (!pool->workers || !pool->lock || !pool->work_ready || !pool->work_done) {
+        lumino_pool_destroy(pool);
+        return NULL;
+    }
+
+    for (int i = 0; i < thread_count - 1; i++) {
+        pool->workers[i] = SDL_CreateThread(pool_worker, "lumino_worker", pool);
+        if (!pool->workers[i]) {
+            lumino_pool_destroy(pool);
+            return NULL;
+        }
+        pool->worker_count++;
+    }
+    return pool;
+}
+
+void lumino_pool_destroy(lumino_thread_pool* pool) {
+    if (!pool) return;
+
+    if (pool->lock) {
+        SDL_LockMutex(pool->lock);
+        pool->quit = 1;
+        SDL_CondBroadcast(pool->work_ready);
+        SDL_UnlockMutex(pool->lock);
+    }
+    for (int i = 0; i < pool->worker_count; i++) {
+        SDL_WaitThread(pool->workers[i], NULL);
+    }
+
+    if (pool->work_done) SDL_DestroyCond(pool->work_done);
+    if (pool->work_ready) SDL_DestroyCond(pool->work_ready);
+    if (pool->lock) SDL_DestroyMutex(pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+void lumino_pool_run(lumino_thread_pool* pool, lumino_job_fn fn, void* ctx, int count) {
+    if (!pool || count <= 1) {
+        for (int i = 0; i < count; i++) {
+            fn(ctx, i);
+        }
+        return;
+    }
+
+    // publish the batch
+    SDL_LockMutex(pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->job_count = count;
+    SDL_AtomicSet(&pool->next_job, 0);
+    pool->busy_workers = pool->worker_count;
+    pool->generation++;
+    SDL_CondBroadcast(pool->work_ready);
+    SDL_UnlockMutex(pool->lock);
+
+    // the calling thread works too
+    pool_drain(pool);
+
+    SDL_LockMutex(pool->lock);
+    while (pool->busy_workers > 0) {
+        SDL_CondWait(pool->work_done, pool->lock);
+    }
+    SDL_UnlockMutex(pool->lock);
+}
+
+int lumino_pool_thread_count(const lumino_thread_pool* pool) {
+    return pool ? pool->worker_count + 1 : 1;
+}
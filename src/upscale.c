@@ -1,39 +1,70 @@
 #include "upscale.h"
+#include "dispatch.h"
 #include <stdlib.h>
 #include <string.h>
 
-void copyBuffer(uint32_t* dst, const uint32_t* src, int w, int h) {
-    memcpy(dst, src, w * h * sizeof(uint32_t));
+//-----------------------------------------------------------------------------
+// Kernel table, scalar until lumino_dispatch_init picks SIMD variants
+//-----------------------------------------------------------------------------
+
+static void upscale2x_scalar(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h);
+static void expand_row4x_scalar(uint32_t* drow, const uint32_t* srow, int w);
+static void expand_row8x_scalar(uint32_t* drow, const uint32_t* srow, int w);
+static void expand_rowNx_scalar(uint32_t* drow, const uint32_t* srow, int w, int n);
+static void palette_convert_scalar(uint32_t* dst, const uint8_t* src, const uint32_t* palette, int N);
+
+static struct {
+    void (*upscale2x)(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h);
+    void (*expand_row4x)(uint32_t* drow, const uint32_t* srow, int w);
+    void (*expand_row8x)(uint32_t* drow, const uint32_t* srow, int w);
+    void (*expand_rowNx)(uint32_t* drow, const uint32_t* srow, int w, int n);
+    void (*palette_convert)(uint32_t* dst, const uint8_t* src, const uint32_t* palette, int N);
+} kernels = {
+    upscale2x_scalar,
+    expand_row4x_scalar,
+    expand_row8x_scalar,
+    expand_rowNx_scalar,
+    palette_convert_scalar,
+};
+
+void copyBuffer(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h, int n) {
+    (void)n;
+    if (dst_stride == w && src_stride == w) {
+        memcpy(dst, src, (size_t)w * h * sizeof(uint32_t));
+        return;
+    }
+    for (int y = 0; y < h; y++) {
+        memcpy(dst + (size_t)y * dst_stride, src + (size_t)y * src_stride, w * sizeof(uint32_t));
+    }
 }
 
-// Scalar fallback (in case NEON isn't available)
-static void upscale2x_scalar(uint32_t* dst, const uint32_t* src,
-                             int w, int h) {
-    int dw = w * 2;
+// Scalar fallback (in case no SIMD level is available)
+static void upscale2x_scalar(uint32_t* dst, int dst_stride,
+                             const uint32_t* src, int src_stride, int w, int h) {
     for (int y = 0; y < h; y++) {
         for (int x = 0; x < w; x++) {
-            uint32_t c = src[y*w + x];
+            uint32_t c = src[(size_t)y*src_stride + x];
             int dx = x*2, dy = y*2;
-            dst[ (dy  )*dw + (dx  ) ] = c;
-            dst[ (dy  )*dw + (dx+1) ] = c;
-            dst[ (dy+1)*dw + (dx  ) ] = c;
-            dst[ (dy+1)*dw + (dx+1) ] = c;
+            dst[ (dy  )*dst_stride + (dx  ) ] = c;
+            dst[ (dy  )*dst_stride + (dx+1) ] = c;
+            dst[ (dy+1)*dst_stride + (dx  ) ] = c;
+            dst[ (dy+1)*dst_stride + (dx+1) ] = c;
         }
     }
 }
 
 #if defined(__ARM_NEON__)
-static void upscale2x_neon(uint32_t* dst, const uint32_t* src,
-                           int w, int h) {
-    int dw = w * 2;
+static void upscale2x_neon(uint32_t* dst, int dst_stride,
+                           const uint32_t* src, int src_stride, int w, int h) {
     for (int y = 0; y < h; y++) {
         // srow = current row in src
-        const uint32_t* srow = src + y*w;
+        const uint32_t* srow = src + (size_t)y*src_stride;
         // drow0 = current row in dst
-        uint32_t* drow0 = dst + (y*2)*dw;
+        uint32_t* drow0 = dst + (y*2)*dst_stride;
         // drow1 = next row in dst
-        uint32_t* drow1 = dst + (y*2+1)*dw;
-        for (int x = 0; x < w; x += 4) {
+        uint32_t* drow1 = dst + (y*2+1)*dst_stride;
+        int x = 0;
+        for (; x <= w - 4; x += 4) {
             // Load 4 pixels
             uint32x4_t pix = vld1q_u32(srow + x);
             // Duplicate each lane: zip pix with itself
@@ -44,72 +75,465 @@ static void upscale2x_neon(uint32_t* dst, const uint32_t* src,
             vst1q_u32(drow1 + x*2,     dup.val[0]);
             vst1q_u32(drow1 + x*2 + 4, dup.val[1]);
         }
+        // tail pixels
+        for (; x < w; x++) {
+            uint32_t c = srow[x];
+            drow0[x*2] = drow0[x*2 + 1] = c;
+            drow1[x*2] = drow1[x*2 + 1] = c;
+        }
     }
 }
 #endif
 
+#if defined(LUMINO_X86)
+LUMINO_TARGET_AVX2
+static void upscale2x_avx2(uint32_t* dst, int dst_stride,
+                           const uint32_t* src, int src_stride, int w, int h) {
+    for (int y = 0; y < h; y++) {
+        const uint32_t* srow = src + (size_t)y*src_stride;
+        uint32_t* drow0 = dst + (y*2)*dst_stride;
+        uint32_t* drow1 = dst + (y*2+1)*dst_stride;
+        int x = 0;
+        for (; x <= w - 8; x += 8) {
+            // Load 8 pixels: [p0..p3 | p4..p7]
+            __m256i pix = _mm256_loadu_si256((const __m256i*)(srow + x));
+            // unpack works per 128-bit lane:
+            // lo = [p0,p0,p1,p1 | p4,p4,p5,p5], hi = [p2,p2,p3,p3 | p6,p6,p7,p7]
+            __m256i lo = _mm256_unpacklo_epi32(pix, pix);
+            __m256i hi = _mm256_unpackhi_epi32(pix, pix);
+            // stitch the lanes back into order
+            __m256i out0 = _mm256_permute2x128_si256(lo, hi, 0x20); // p0..p3 doubled
+            __m256i out1 = _mm256_permute2x128_si256(lo, hi, 0x31); // p4..p7 doubled
+            _mm256_storeu_si256((__m256i*)(drow0 + x*2),     out0);
+            _mm256_storeu_si256((__m256i*)(drow0 + x*2 + 8), out1);
+            _mm256_storeu_si256((__m256i*)(drow1 + x*2),     out0);
+            _mm256_storeu_si256((__m256i*)(drow1 + x*2 + 8), out1);
+        }
+        // tail pixels
+        for (; x < w; x++) {
+            uint32_t c = srow[x];
+            drow0[x*2] = drow0[x*2 + 1] = c;
+            drow1[x*2] = drow1[x*2 + 1] = c;
+        }
+    }
+}
+#endif
 
+#if defined(LUMINO_X86)
+LUMINO_TARGET_SSE2
+static void upscale2x_sse2(uint32_t* dst, int dst_stride,
+                           const uint32_t* src, int src_stride, int w, int h) {
+    for (int y = 0; y < h; y++) {
+        const uint32_t* srow = src + (size_t)y*src_stride;
+        uint32_t* drow0 = dst + (y*2)*dst_stride;
+        uint32_t* drow1 = dst + (y*2+1)*dst_stride;
+        int x = 0;
+        for (; x <= w - 4; x += 4) {
+            // Load 4 pixels, lo = [p0,p0,p1,p1], hi = [p2,p2,p3,p3]
+            __m128i pix = _mm_loadu_si128((const __m128i*)(srow + x));
+            __m128i lo  = _mm_unpacklo_epi32(pix, pix);
+            __m128i hi  = _mm_unpackhi_epi32(pix, pix);
+            _mm_storeu_si128((__m128i*)(drow0 + x*2),     lo);
+            _mm_storeu_si128((__m128i*)(drow0 + x*2 + 4), hi);
+            _mm_storeu_si128((__m128i*)(drow1 + x*2),     lo);
+            _mm_storeu_si128((__m128i*)(drow1 + x*2 + 4), hi);
+        }
+        // tail pixels
+        for (; x < w; x++) {
+            uint32_t c = srow[x];
+            drow0[x*2] = drow0[x*2 + 1] = c;
+            drow1[x*2] = drow1[x*2 + 1] = c;
+        }
+    }
+}
+#endif
 
+//-----------------------------------------------------------------------------
+// Direct 4x / 8x: every pixel of a source row is broadcast into a 4- or 8-wide
+// run and the expanded row is stored to each of its N destination rows. The
+// source row stays in L1, so re-expanding it is cheaper than reading dst
+// back: dst may be a locked streaming texture, which must be treated as
+// write-only. No intermediate frame.
+//-----------------------------------------------------------------------------
 
+static void expand_row4x_scalar(uint32_t* drow, const uint32_t* srow, int w) {
+    for (int x = 0; x < w; x++) {
+        uint32_t c = srow[x];
+        drow[x*4    ] = c;
+        drow[x*4 + 1] = c;
+        drow[x*4 + 2] = c;
+        drow[x*4 + 3] = c;
+    }
+}
 
-void upscale4x(uint32_t* dst, const uint32_t* src,
-                   int w, int h) {
-    // create intermediate buffer
-    int w2 = w * 2;
-    int h2 = h * 2;
-    uint32_t* tmp = (uint32_t*)malloc(w2 * h2 * sizeof(uint32_t));
-    if (!tmp) {
-        return;  // Memory allocation failed
+static void expand_row8x_scalar(uint32_t* drow, const uint32_t* srow, int w) {
+    for (int x = 0; x < w; x++) {
+        uint32_t c = srow[x];
+        for (int i = 0; i < 8; i++) {
+            drow[x*8 + i] = c;
+        }
     }
-    // upscale to 2x
-    upscale2x(tmp, src, w, h);
-    // upscale to 4x
-    upscale2x(dst, tmp, w2, h2);
-    // free intermediate buffer
-    free(tmp);
 }
 
-void upscale8x(uint32_t* dst, const uint32_t* src,
-                   int w, int h) {
-    // create intermediate buffer
-    int w4 = w * 4;
-    int h4 = h * 4;
-    uint32_t* tmp = (uint32_t*)malloc(w4 * h4 * sizeof(uint32_t));
-    if (!tmp) {
-        return;  // Memory allocation failed
+#if defined(__ARM_NEON__)
+static void expand_row4x_neon(uint32_t* drow, const uint32_t* srow, int w) {
+    int x = 0;
+    for (; x <= w - 4; x += 4) {
+        uint32x4_t pix = vld1q_u32(srow + x);
+        vst1q_u32(drow + x*4,      vdupq_laneq_u32(pix, 0));
+        vst1q_u32(drow + x*4 + 4,  vdupq_laneq_u32(pix, 1));
+        vst1q_u32(drow + x*4 + 8,  vdupq_laneq_u32(pix, 2));
+        vst1q_u32(drow + x*4 + 12, vdupq_laneq_u32(pix, 3));
     }
-    // upscale to 4x
-    upscale4x(tmp, src, w, h);
-    // upscale to 8x
-    upscale2x(dst, tmp, w4, h4);
-    // free intermediate buffer
-    free(tmp);
+    expand_row4x_scalar(drow + x*4, srow + x, w - x);
+}
 
+static void expand_row8x_neon(uint32_t* drow, const uint32_t* srow, int w) {
+    for (int x = 0; x < w; x++) {
+        uint32x4_t c = vld1q_dup_u32(srow + x);
+        vst1q_u32(drow + x*8,     c);
+        vst1q_u32(drow + x*8 + 4, c);
+    }
 }
+#endif
 
-void upscale16x(uint32_t* dst, const uint32_t* src,
-                   int w, int h) {
-    // create intermediate buffer
-    int w8 = w * 8;
-    int h8 = h * 8;
-    uint32_t* tmp = (uint32_t*)malloc(w8 * h8 * sizeof(uint32_t));
-    if (!tmp) {
-        return;  // Memory allocation failed
+#if defined(LUMINO_X86)
+LUMINO_TARGET_AVX2
+static void expand_row4x_avx2(uint32_t* drow, const uint32_t* srow, int w) {
+    // permutation indices: each output vector holds two source pixels x4
+    const __m256i idx0 = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    const __m256i idx1 = _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3);
+    const __m256i idx2 = _mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5);
+    const __m256i idx3 = _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7);
+    int x = 0;
+    for (; x <= w - 8; x += 8) {
+        __m256i pix = _mm256_loadu_si256((const __m256i*)(srow + x));
+        _mm256_storeu_si256((__m256i*)(drow + x*4),      _mm256_permutevar8x32_epi32(pix, idx0));
+        _mm256_storeu_si256((__m256i*)(drow + x*4 + 8),  _mm256_permutevar8x32_epi32(pix, idx1));
+        _mm256_storeu_si256((__m256i*)(drow + x*4 + 16), _mm256_permutevar8x32_epi32(pix, idx2));
+        _mm256_storeu_si256((__m256i*)(drow + x*4 + 24), _mm256_permutevar8x32_epi32(pix, idx3));
+    }
+    expand_row4x_scalar(drow + x*4, srow + x, w - x);
+}
+
+LUMINO_TARGET_AVX2
+static void expand_row8x_avx2(uint32_t* drow, const uint32_t* srow, int w) {
+    for (int x = 0; x < w; x++) {
+        // vpbroadcastd straight from memory
+        _mm256_storeu_si256((__m256i*)(drow + x*8), _mm256_set1_epi32((int)srow[x]));
+    }
+}
+#endif
+
+#if defined(LUMINO_X86)
+LUMINO_TARGET_SSE2
+static void expand_row4x_sse2(uint32_t* drow, const uint32_t* srow, int w) {
+    int x = 0;
+    for (; x <= w - 4; x += 4) {
+        __m128i pix = _mm_loadu_si128((const __m128i*)(srow + x));
+        _mm_storeu_si128((__m128i*)(drow + x*4),      _mm_shuffle_epi32(pix, 0x00));
+        _mm_storeu_si128((__m128i*)(drow + x*4 + 4),  _mm_shuffle_epi32(pix, 0x55));
+        _mm_storeu_si128((__m128i*)(drow + x*4 + 8),  _mm_shuffle_epi32(pix, 0xAA));
+        _mm_storeu_si128((__m128i*)(drow + x*4 + 12), _mm_shuffle_epi32(pix, 0xFF));
+    }
+    expand_row4x_scalar(drow + x*4, srow + x, w - x);
+}
+
+LUMINO_TARGET_SSE2
+static void expand_row8x_sse2(uint32_t* drow, const uint32_t* srow, int w) {
+    for (int x = 0; x < w; x++) {
+        __m128i c = _mm_set1_epi32((int)srow[x]);
+        _mm_storeu_si128((__m128i*)(drow + x*8),     c);
+        _mm_storeu_si128((__m128i*)(drow + x*8 + 4), c);
+    }
+}
+#endif
+
+void upscale4x(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride,
+                   int w, int h, int n) {
+    (void)n;
+    for (int y = 0; y < h; y++) {
+        const uint32_t* srow = src + (size_t)y*src_stride;
+        uint32_t* drow = dst + (size_t)(y*4) * dst_stride;
+        for (int i = 0; i < 4; i++) {
+            kernels.expand_row4x(drow + (size_t)i * dst_stride, srow, w);
+        }
+    }
+}
+
+void upscale8x(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride,
+                   int w, int h, int n) {
+    (void)n;
+    for (int y = 0; y < h; y++) {
+        const uint32_t* srow = src + (size_t)y*src_stride;
+        uint32_t* drow = dst + (size_t)(y*8) * dst_stride;
+        for (int i = 0; i < 8; i++) {
+            kernels.expand_row8x(drow + (size_t)i * dst_stride, srow, w);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Generic integer N: same row-expand scheme as 4x/8x. The vector
+// kernels broadcast the pixel and cover its N-wide run with full-width stores;
+// when N is not a multiple of the vector width the last store is shifted back
+// so it overlaps the run instead of spilling into the next pixel.
+//-----------------------------------------------------------------------------
+
+static void expand_rowNx_scalar(uint32_t* drow, const uint32_t* srow, int w, int n) {
+    for (int x = 0; x < w; x++) {
+        uint32_t c = srow[x];
+        uint32_t* d = drow + x*n;
+        for (int i = 0; i < n; i++) {
+            d[i] = c;
+        }
+    }
+}
+
+#if defined(__ARM_NEON__)
+static void expand_rowNx_neon(uint32_t* drow, const uint32_t* srow, int w, int n) {
+    if (n < 4) {
+        expand_rowNx_scalar(drow, srow, w, n);
+        return;
+    }
+    for (int x = 0; x < w; x++) {
+        uint32x4_t c = vld1q_dup_u32(srow + x);
+        uint32_t* d = drow + x*n;
+        int i = 0;
+        for (; i <= n - 4; i += 4) {
+            vst1q_u32(d + i, c);
+        }
+        if (i < n) {
+            vst1q_u32(d + n - 4, c);
+        }
+    }
+}
+#endif
+
+#if defined(LUMINO_X86)
+LUMINO_TARGET_AVX2
+static void expand_rowNx_avx2(uint32_t* drow, const uint32_t* srow, int w, int n) {
+    if (n < 8) {
+        // one 8-wide store per pixel; it overruns into the next run, which the
+        // next iteration overwrites. Stop while the store still fits the row.
+        int dw = w * n;
+        int x = 0;
+        for (; x < w && x*n + 8 <= dw; x++) {
+            _mm256_storeu_si256((__m256i*)(drow + x*n), _mm256_set1_epi32((int)srow[x]));
+        }
+        expand_rowNx_scalar(drow + x*n, srow + x, w - x, n);
+        return;
+    }
+    for (int x = 0; x < w; x++) {
+        __m256i c = _mm256_set1_epi32((int)srow[x]);
+        uint32_t* d = drow + x*n;
+        int i = 0;
+        for (; i <= n - 8; i += 8) {
+            _mm256_storeu_si256((__m256i*)(d + i), c);
+        }
+        if (i < n) {
+            _mm256_storeu_si256((__m256i*)(d + n - 8), c);
+        }
+    }
+}
+#endif
+
+#if defined(LUMINO_X86)
+LUMINO_TARGET_SSE2
+static void expand_rowNx_sse2(uint32_t* drow, const uint32_t* srow, int w, int n) {
+    if (n < 4) {
+        int dw = w * n;
+        int x = 0;
+        for (; x < w && x*n + 4 <= dw; x++) {
+            _mm_storeu_si128((__m128i*)(drow + x*n), _mm_set1_epi32((int)srow[x]));
+        }
+        expand_rowNx_scalar(drow + x*n, srow + x, w - x, n);
+        return;
+    }
+    for (int x = 0; x < w; x++) {
+        __m128i c = _mm_set1_epi32((int)srow[x]);
+        uint32_t* d = drow + x*n;
+        int i = 0;
+        for (; i <= n - 4; i += 4) {
+            _mm_storeu_si128((__m128i*)(d + i), c);
+        }
+        if (i < n) {
+            _mm_storeu_si128((__m128i*)(d + n - 4), c);
+        }
+    }
+}
+#endif
+
+// Any integer factor n >= 1; powers of two we have kernels for are forwarded.
+void upscaleNx(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h, int n) {
+    switch (n) {
+        case 1: copyBuffer(dst, dst_stride, src, src_stride, w, h, n); return;
+        case 2: upscale2x(dst, dst_stride, src, src_stride, w, h, n);  return;
+        case 4: upscale4x(dst, dst_stride, src, src_stride, w, h, n);  return;
+        case 8: upscale8x(dst, dst_stride, src, src_stride, w, h, n);  return;
+        default: break;
+    }
+
+    for (int y = 0; y < h; y++) {
+        const uint32_t* srow = src + (size_t)y*src_stride;
+        uint32_t* drow = dst + (size_t)(y*n) * dst_stride;
+        for (int i = 0; i < n; i++) {
+            kernels.expand_rowNx(drow + (size_t)i * dst_stride, srow, w, n);
+        }
     }
-    // upscale to 8x
-    upscale8x(tmp, src, w, h);
-    // upscale to 16x
-    upscale2x(dst, tmp, w8, h8);
-    // free intermediate buffer
-    free(tmp);
 }
 
 // Single 2× dispatcher
-void upscale2x(uint32_t* dst, const uint32_t* src, int w, int h) {
-  #if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
-    upscale2x_neon(dst, src, w, h);
-  #else
-    upscale2x_scalar(dst, src, w, h);
-  #endif
+void upscale2x(uint32_t* dst, int dst_stride, const uint32_t* src, int src_stride, int w, int h, int n) {
+    (void)n;
+    kernels.upscale2x(dst, dst_stride, src, src_stride, w, h);
+}
+
+
+//-----------------------------------------------------------------------------
+// Palette conversion: 8-bit indices -> packed 32-bit colors
+//-----------------------------------------------------------------------------
+
+static void palette_convert_scalar(uint32_t* dst, const uint8_t* src,
+                                   const uint32_t* palette, int N) {
+    for (int i = 0; i < N; i++) {
+        dst[i] = palette[src[i]];
+    }
+}
+
+#if defined(__ARM_NEON__)
+// vqtbl4q_u8 looks bytes up in a 64-entry table and returns 0 for indices
+// >= 64. Split each byte plane of the palette into four 64-entry tables and
+// OR the four lookups of (idx - 0), (idx - 64), (idx - 128), (idx - 192).
+static void palette_convert_neon(uint32_t* dst, const uint8_t* src,
+                                 const uint32_t* palette, int N) {
+    uint8_t planes[4][256];
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = palette[i];
+        planes[0][i] = (uint8_t)(c      );
+        planes[1][i] = (uint8_t)(c >>  8);
+        planes[2][i] = (uint8_t)(c >> 16);
+        planes[3][i] = (uint8_t)(c >> 24);
+    }
+
+    uint8x16x4_t tbl[4][4];
+    for (int c = 0; c < 4; c++) {
+        for (int k = 0; k < 4; k++) {
+            tbl[c][k].val[0] = vld1q_u8(planes[c] + k*64);
+            tbl[c][k].val[1] = vld1q_u8(planes[c] + k*64 + 16);
+            tbl[c][k].val[2] = vld1q_u8(planes[c] + k*64 + 32);
+            tbl[c][k].val[3] = vld1q_u8(planes[c] + k*64 + 48);
+        }
+    }
+
+    const uint8x16_t step = vdupq_n_u8(64);
+    int i = 0;
+    for (; i <= N - 16; i += 16) {
+        uint8x16_t idx0 = vld1q_u8(src + i);
+        uint8x16_t idx1 = vsubq_u8(idx0, step);
+        uint8x16_t idx2 = vsubq_u8(idx1, step);
+        uint8x16_t idx3 = vsubq_u8(idx2, step);
+
+        // one plane per output byte, interleaved back to pixels by vst4q
+        uint8x16x4_t out;
+        for (int c = 0; c < 4; c++) {
+            out.val[c] = vorrq_u8(vorrq_u8(vqtbl4q_u8(tbl[c][0], idx0),
+                                           vqtbl4q_u8(tbl[c][1], idx1)),
+                                  vorrq_u8(vqtbl4q_u8(tbl[c][2], idx2),
+                                           vqtbl4q_u8(tbl[c][3], idx3)));
+        }
+        vst4q_u8((uint8_t*)(dst + i), out);
+    }
+    palette_convert_scalar(dst + i, src + i, palette, N - i);
+}
+#endif
+
+#if defined(LUMINO_X86)
+LUMINO_TARGET_AVX2
+static void palette_convert_avx2(uint32_t* dst, const uint8_t* src,
+                                 const uint32_t* palette, int N) {
+    int i = 0;
+    for (; i <= N - 16; i += 16) {
+        // widen 2 x 8 indices to 32-bit lanes and gather the colors
+        __m256i idx0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+        __m256i idx1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + 8)));
+        __m256i px0  = _mm256_i32gather_epi32((const int*)palette, idx0, 4);
+        __m256i px1  = _mm256_i32gather_epi32((const int*)palette, idx1, 4);
+        _mm256_storeu_si256((__m256i*)(dst + i),     px0);
+        _mm256_storeu_si256((__m256i*)(dst + i + 8), px1);
+    }
+    palette_convert_scalar(dst + i, src + i, palette, N - i);
+}
+#endif
+
+void palette_convert(uint32_t* dst, const uint8_t* src, const uint32_t* palette, int N) {
+    kernels.palette_convert(dst, src, palette, N);
 }
 
+// Row segments are converted into a small stack buffer that stays in L1 and
+// expanded from there by the regular upscalers (with h = 1 they write exactly
+// the n destination rows of one source row).
+#define PALETTE_UPSCALE_CHUNK 256
+
+void palette_upscale(uint32_t* dst, int dst_stride, const uint8_t* src, int src_stride,
+                     const uint32_t* palette, int w, int h, int n) {
+    if (n == 1) {
+        for (int y = 0; y < h; y++) {
+            palette_convert(dst + (size_t)y * dst_stride, src + (size_t)y * src_stride, palette, w);
+        }
+        return;
+    }
+
+    uint32_t chunk[PALETTE_UPSCALE_CHUNK];
+    for (int y = 0; y < h; y++) {
+        const uint8_t* srow = src + (size_t)y * src_stride;
+        uint32_t* drow = dst + (size_t)y * n * dst_stride;
+        for (int x = 0; x < w; x += PALETTE_UPSCALE_CHUNK) {
+            int cw = w - x < PALETTE_UPSCALE_CHUNK ? w - x : PALETTE_UPSCALE_CHUNK;
+            palette_convert(chunk, srow + x, palette, cw);
+            upscaleNx(drow + (size_t)x * n, dst_stride, chunk, cw, cw, 1, n);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Kernel selection
+//-----------------------------------------------------------------------------
+
+void lumino_upscale_select_kernels(int level) {
+    kernels.upscale2x       = upscale2x_scalar;
+    kernels.expand_row4x    = expand_row4x_scalar;
+    kernels.expand_row8x    = expand_row8x_scalar;
+    kernels.expand_rowNx    = expand_rowNx_scalar;
+    kernels.palette_convert = palette_convert_scalar;
+
+    switch (level) {
+#if defined(__ARM_NEON__) && !defined(LUMINO_NO_NEON)
+        case LUMINO_SIMD_NEON:
+            kernels.upscale2x       = upscale2x_neon;
+            kernels.expand_row4x    = expand_row4x_neon;
+            kernels.expand_row8x    = expand_row8x_neon;
+            kernels.expand_rowNx    = expand_rowNx_neon;
+            kernels.palette_convert = palette_convert_neon;
+            break;
+#endif
+#if defined(LUMINO_X86)
+        case LUMINO_SIMD_AVX2:
+            kernels.upscale2x       = upscale2x_avx2;
+            kernels.expand_row4x    = expand_row4x_avx2;
+            kernels.expand_row8x    = expand_row8x_avx2;
+            kernels.expand_rowNx    = expand_rowNx_avx2;
+            kernels.palette_convert = palette_convert_avx2;
+            break;
+        case LUMINO_SIMD_SSE2:
+            // no SSE2 palette kernel: without a gather it is no faster than scalar
+            kernels.upscale2x       = upscale2x_sse2;
+            kernels.expand_row4x    = expand_row4x_sse2;
+            kernels.expand_row8x    = expand_row8x_sse2;
+            kernels.expand_rowNx    = expand_rowNx_sse2;
+            break;
+#endif
+        default:
+            break;
+    }
+}